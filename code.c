@@ -6,8 +6,8 @@
 /* ------------------------------------------------------------------------------------------------------------------------------------------ */
 /* Instructions:                                                                                                                              */
 /* 1. Start the game by waving at the IR sensor. The LED would turn green.                                                                    */
-/* 2. The game has 3 levels (Easy, Medium, and Hard).                                                                                         */
-/* 3. Click on 1 on the keypad to play the easy level, 2 for the medium level, and 3 for the hard level.                                      */
+/* 2. The game has 4 levels (Easy, Medium, Hard, and Mixed).                                                                                  */
+/* 3. Click on 1 on the keypad to play the easy level, 2 for the medium level, 3 for the hard level, and 4 for the mixed level.               */
 /* 4. There are 10 questions in each game.                                                                                                    */
 /* 5. Make sure to answer quickly, the game is set by a timer for every question. The timer is displayed on the LCD.                          */
 /* 6. If you click the wrong key, you can click on "D" on they keypad to erase the last typed number.                                         */
@@ -17,36 +17,192 @@
 /* 10. If you choose the easy level, you have 20 seconds to answer a "+", "-", "*", or "" math question displayed on the LCD.                */
 /* 11. If you choose the medium level, only the operation is displayed on the LCD. You have to observe how many times the blue LED blinks.    */
 /* 12. The hard level is similar, except that you have to listen carefully to the speaker and count how many times it "buzzes"!               */
-/* 13. For medium and hard levels, a duration of a second separates the first number from the second.                                         */
-/* 14. In these two levels, you only have 15 and 10 seconds to perform math operations in your head on the two numbers and type your answers. */
+/* 13. In the mixed level, the blue LED blinks the first number and the speaker buzzes the second one. A second separates the two numbers.    */
+/* 14. You only have 15 seconds (medium) or 10 seconds (hard and mixed) to do the math in your head and type your answer.                     */
 /* 15. At the end of each game, your game score is displayed on the LCD, and then your total game scores.                                     */
-/* 16. If you decide to stop the game at any time, you can click on "*" on the keypad.                                                        */
-/* 17. Don't worry, you can play the game again at any time by waving at the IR sensor.                                                       */
-/* 18. Have fun!                                                                                                                              */
+/* 16. Choose your player profile by clicking on A, B, or C on the difficulty menu. Each profile has its own total score.                     */
+/* 17. If you decide to stop the game at any time, you can click on "*" on the keypad.                                                        */
+/* 18. Don't worry, you can play the game again at any time by waving at the IR sensor.                                                       */
+/* 19. Have fun!                                                                                                                              */
 /* ------------------------------------------------------------------------------------------------------------------------------------------ */
 /* Made by Mariam Alzaabi                                                                                                                     */
 /* 23/11/2020                                                                                                                                 */
 /* ------------------------------------------------------------------------------------------------------------------------------------------ */
 
+#ifdef SPEEDMATH_HOST
+#include "host/simulator.h" //in-memory LCD, keypad, EEPROM, clock and registers for the Linux simulator
+#else
 #include <Keypad.h> //Keypad library
 #include <LiquidCrystal_I2C.h> //LCD library
+#include <Wire.h> //I2C library used to batch writes to the LCD
 #include <EEPROM.h> //EEPROM library
+#include <avr/sleep.h> //power-down sleep while nobody plays
+#endif
+
+// Function used to reach an I/O register whose data space address is known when compiling (memory owned by the simulator on Linux):
+// a bit of the low I/O space compiles to one sbi/cbi/sbis instruction, any other access to one in/out/lds/sts
+template <unsigned int ADDRESS> inline volatile byte &ioRegister() {
+#ifdef SPEEDMATH_HOST
+  return hostRegisters[ADDRESS];
+#else
+  return *(volatile byte *)ADDRESS;
+#endif
+}
+
+// I/O port of the ATmega328P, its PINx, DDRx and PORTx registers follow each other in the data space
+template <unsigned int PIN_ADDRESS> struct IoPort
+{
+  static volatile byte &input() { return ioRegister<PIN_ADDRESS>(); } //PINx: levels read on the pins
+  static volatile byte &direction() { return ioRegister<PIN_ADDRESS + 1>(); } //DDRx: 1 for an output
+  static volatile byte &output() { return ioRegister<PIN_ADDRESS + 2>(); } //PORTx: levels driven, or pull-ups of the inputs
+
+  // Function used to flip some outputs: ones written to PINx toggle PORTx in one instruction, an interrupt cannot come in between
+  static void toggle(byte mask) {
+#ifdef SPEEDMATH_HOST
+    output() ^= mask; //the registers of the simulator are plain memory
+#else
+    input() = mask;
+#endif
+  }
+
+  // Function used to drive some outputs high, a mask only known at run time is a read-modify-write of PORTx: the interrupts that
+  // toggle other pins of the port are held off meanwhile so none of their toggles is lost
+  static void set(byte mask) {
+#ifdef SPEEDMATH_HOST
+    output() |= mask;
+#else
+    byte sreg = SREG; //also called from the Timer1 compare A interrupt
+    cli();
+    output() |= mask;
+    SREG = sreg;
+#endif
+  }
+
+  // Function used to drive some outputs low, same as set()
+  static void clear(byte mask) {
+#ifdef SPEEDMATH_HOST
+    output() &= ~mask;
+#else
+    byte sreg = SREG;
+    cli();
+    output() &= ~mask;
+    SREG = sreg;
+#endif
+  }
+};
+
+typedef IoPort<0x23> PortB; //PINB, DDRB, PORTB
+typedef IoPort<0x29> PortD; //PIND, DDRD, PORTD
+
+// Pin of a port, the port and the bit are template parameters so every access only touches its own bit
+template <class Port, byte BIT> struct IoPin
+{
+  static const byte MASK = 1 << BIT; //bit of the pin in the port registers
+
+  // Function used to make the pin an output
+  static void makeOutput() {
+    Port::direction() |= MASK;
+  }
+
+  // Function used to make the pin an input, with or without its pull-up
+  static void makeInput(bool pullUp) {
+    Port::direction() &= ~MASK;
+    if (pullUp) {
+      Port::output() |= MASK;
+    } else {
+      Port::output() &= ~MASK;
+    }
+  }
+
+  static void high() { Port::output() |= MASK; }
+  static void low() { Port::output() &= ~MASK; }
+  static void toggle() { Port::toggle(MASK); }
+  static bool read() { return (Port::input() & MASK) != 0; }
+
+  // Function used to drive the pin high or low
+  static void write(bool level) {
+    if (level) {
+      high();
+    } else {
+      low();
+    }
+  }
+};
+
+// Timer compare register driving a PWM output, the duty cycle [0-255] is set with one store
+template <unsigned int OCR_ADDRESS> struct PwmOutput
+{
+  static void write(byte duty) { ioRegister<OCR_ADDRESS>() = duty; }
+};
 
 // Defining Arduino pins
-const byte bluePin = 10; //PB2 attach pin D12 (PB2) Arduino to pin Blue of RGB LED
-const byte greenPin = 11; //PB3 attach pin D12 (PB3) Arduino to pin Green of RGB LED
-const byte redPin = 12; //PB4 attach pin D12 (PB4) Arduino to pin Red of RGB LED
-const byte speaker = 13; //PB5 attach pin D13 (PB5) Arduino to speaker pin
+typedef IoPin<PortB, 2> BluePin; //PB2 attach pin D10 Arduino to pin Blue of RGB LED
+typedef IoPin<PortB, 3> GreenPin; //PB3 attach pin D11 Arduino to pin Green of RGB LED (OC2A)
+typedef IoPin<PortB, 4> RedPin; //PB4 attach pin D12 Arduino to pin Red of RGB LED
+typedef IoPin<PortB, 5> SpeakerPin; //PB5 attach pin D13 Arduino to speaker pin
+typedef IoPin<PortD, 1> IrSensorPin; //PD1 attach pin D1 Arduino to the IR sensor output (active low, open collector)
+typedef PwmOutput<0xB3> GreenPwm; //OCR2A, Timer2 runs in phase-correct PWM mode for the green LED only
 const byte potentiometerPin = A0; //attach pin A0 Arduino to potentiometer pin
 
-// Creating pointers to port D and B registers
-byte *ptr_to_PORTD;
-byte *ptr_to_PIND;
-byte *ptr_to_DDRB;
-byte *ptr_to_PORTB;
+// Function used to check if the EEPROM can start a write without waiting for the previous one
+inline bool eepromReady() {
+#ifdef SPEEDMATH_HOST
+  return true;
+#else
+  return eeprom_is_ready();
+#endif
+}
+
+// Functions used to start and stop the 2 kHz Timer1 interrupt of the pulse sequencer (defined next to the interrupt)
+void startPulseTimer();
+void stopPulseTimer();
+
+// Functions used to play a tone on the speaker from the Timer1 compare B interrupt (defined next to the interrupt)
+void startTone(unsigned int frequency, unsigned int durationMs);
+void stopTone();
+bool tonePlaying();
+
+// Functions used to send bytes over the serial port without waiting (defined next to uartSend())
+void uartClaim();
+bool uartWrite(byte value);
+bool uartRelease();
+void uartSend(const byte *data, unsigned int length);
+
+#ifndef SPEEDMATH_HOST
+volatile unsigned int timer1Overflows = 0; //upper 16 bits of the Timer1 tick count
 
-// New shapes created for the LCD screen
-byte smileyFace[] = { //Smiley face used for answers checking
+// Timer1 overflow interrupt, fires every 32.768 ms to extend the 16-bit counter
+ISR(TIMER1_OVF_vect) {
+  timer1Overflows += 1;
+}
+#endif
+
+// Length of a profiler tick in nanoseconds (0.5 us Timer1 ticks on the board, host time on Linux)
+#ifdef SPEEDMATH_HOST
+const unsigned int PROFILE_TICK_NS = 1;
+#else
+const unsigned int PROFILE_TICK_NS = 500;
+#endif
+
+// Function used to read a 32-bit time stamp for the profiler, in ticks of PROFILE_TICK_NS
+inline unsigned long profileTicks() {
+#ifdef SPEEDMATH_HOST
+  return (unsigned long)simHostNanos();
+#else
+  byte sreg = SREG; //the interrupts may already be disabled (keypad interrupt)
+  cli();
+  unsigned int low = TCNT1;
+  unsigned int high = timer1Overflows;
+  if ((TIFR1 & _BV(TOV1)) && (low < 0x8000)) { //the counter wrapped but the overflow interrupt has not run yet
+    high += 1;
+  }
+  SREG = sreg;
+  return ((unsigned long)high << 16) | low;
+#endif
+}
+
+// New shapes created for the LCD screen, kept in flash and copied to the LCD when needed
+const byte smileyFace[] PROGMEM = { //Smiley face used for answers checking
   B00000,
   B00000,
   B01010,
@@ -56,7 +212,7 @@ byte smileyFace[] = { //Smiley face used for answers checking
   B00000,
   B00000
 };
-byte sadFace[] = { //Sad face used for answers checking
+const byte sadFace[] PROGMEM = { //Sad face used for answers checking
   B00000,
   B00000,
   B01010,
@@ -66,7 +222,7 @@ byte sadFace[] = { //Sad face used for answers checking
   B00000,
   B00000
 };
-byte blankChar[] = { //Blank character used for M/H game levels
+const byte blankChar[] PROGMEM = { //Blank character used for M/H game levels
   B11111,
   B11111,
   B11111,
@@ -77,8 +233,244 @@ byte blankChar[] = { //Blank character used for M/H game levels
   B11111
 };
 
-// Creating object from LCD library to control LCD
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+// Divisors of every number from 1 to DIVIDEND_MAX, used to pick division questions without retrying. The table is built by the
+// compiler: the divisors of n are listed in increasing order, and they end where the ones of n + 1 start.
+const byte DIVIDEND_MAX = 99; //largest dividend of a division question
+
+// Function used to count the divisors of n that are not above d
+constexpr unsigned int divisorsUpTo(unsigned int n, unsigned int d) {
+  return (d == 0) ? 0 : (divisorsUpTo(n, d - 1) + (((n % d) == 0) ? 1 : 0));
+}
+
+// Function used to get the position of the first divisor of n in the list (n = DIVIDEND_MAX + 1 gives the size of the list)
+constexpr unsigned int firstDivisor(unsigned int n) {
+  return (n <= 1) ? 0 : (firstDivisor(n - 1) + divisorsUpTo(n - 1, n - 1));
+}
+
+const unsigned int DIVISOR_COUNT = firstDivisor(DIVIDEND_MAX + 1); //size of the list
+
+// Positions 0 to N - 1, used to expand a table entry by entry at compile time (split in halves to keep the templates shallow)
+template <unsigned int... I> struct Positions {};
+template <typename A, typename B> struct JoinPositions;
+template <unsigned int... A, unsigned int... B> struct JoinPositions<Positions<A...>, Positions<B...> > {
+  typedef Positions<A..., (sizeof...(A) + B)...> type;
+};
+template <unsigned int N> struct MakePositions {
+  typedef typename JoinPositions<typename MakePositions<N / 2>::type, typename MakePositions<N - N / 2>::type>::type type;
+};
+template <> struct MakePositions<0> {
+  typedef Positions<> type;
+};
+template <> struct MakePositions<1> {
+  typedef Positions<0> type;
+};
+
+// Position of the first divisor of every dividend, only used by the compiler to fill the divisor table
+struct DivisorStarts {
+  unsigned int at[DIVIDEND_MAX + 2];
+};
+
+// Function used to make the positions of the first divisors at compile time
+template <unsigned int... N> constexpr DivisorStarts makeDivisorStarts(Positions<N...>) {
+  return {{firstDivisor(N)...}};
+}
+
+constexpr DivisorStarts DIVISOR_STARTS = makeDivisorStarts(MakePositions<DIVIDEND_MAX + 2>::type());
+
+// Function used to get the number whose divisors hold a position of the list, looking from n up
+constexpr unsigned int dividendAt(unsigned int position, unsigned int n = 1) {
+  return (DIVISOR_STARTS.at[n + 1] > position) ? n : dividendAt(position, n + 1);
+}
+
+// Function used to get the divisor of n that comes after k others, looking from d up
+constexpr unsigned int nthDivisor(unsigned int n, unsigned int k, unsigned int d = 1) {
+  return ((n % d) != 0) ? nthDivisor(n, k, d + 1) : ((k == 0) ? d : nthDivisor(n, k - 1, d + 1));
+}
+
+// Function used to get the divisor at a position of the list
+constexpr byte divisorAt(unsigned int position) {
+  return nthDivisor(dividendAt(position), position - DIVISOR_STARTS.at[dividendAt(position)]);
+}
+
+// Divisors of every dividend and the position of the first one of each, indexed by the dividend (0 to DIVIDEND_MAX + 1)
+struct DivisorTable {
+  byte list[DIVISOR_COUNT]; //divisors of 1, then of 2...
+  unsigned int start[DIVIDEND_MAX + 2]; //position of the first divisor of n in list
+};
+
+// Function used to make the divisor table at compile time
+template <unsigned int... L, unsigned int... S> constexpr DivisorTable makeDivisorTable(Positions<L...>, Positions<S...>) {
+  return {{divisorAt(L)...}, {DIVISOR_STARTS.at[S]...}};
+}
+
+const DivisorTable DIVISORS PROGMEM = makeDivisorTable(MakePositions<DIVISOR_COUNT>::type(), MakePositions<DIVIDEND_MAX + 2>::type());
+
+// Slots of the custom characters in the LCD memory (CGRAM)
+const byte GLYPH_SMILEY = 0; //smiley face
+const byte GLYPH_SAD = 1; //sad face
+const byte GLYPH_BLANK = 2; //blank character
+
+// Set to 1 to run the I2C bus in 400 kHz fast mode (the PCF8574 backpack is only rated for 100 kHz)
+#define LCD_FAST_MODE 0
+
+// Copy of the 16x2 LCD kept in SRAM, only the cells that changed are sent over I2C
+class LcdBuffer : public Print
+{
+  public:
+    static const byte LCD_COLS = 16; //number of columns
+    static const byte LCD_CELLS = 32; //number of cells (16x2)
+    static const byte BATCH_SIZE = 32; //size of the Wire library transmit buffer
+    static const byte PIN_RS = 0x01; //PCF8574 pin connected to RS (data/command select)
+    static const byte PIN_EN = 0x04; //PCF8574 pin connected to EN (enable)
+    static const byte PIN_BACKLIGHT = 0x08; //PCF8574 pin connected to the backlight
+    static const byte NO_POSITION = 0xFF; //the LCD address counter is not in the visible area
+
+    LiquidCrystal_I2C &device; //LCD library object, used for initialization and the backlight
+    byte address; //I2C address of the LCD backpack
+    char cells[LCD_CELLS]; //what should be displayed
+    char shown[LCD_CELLS]; //what is currently displayed on the LCD
+    const byte *glyphs[8]; //custom character loaded in each CGRAM slot
+    byte cursor = 0; //position of the next character written to the buffer
+    byte lcdCursor = NO_POSITION; //position of the LCD address counter
+    byte backlightBit = 0; //current state of the backlight pin
+    byte pending = 0; //bytes in the current I2C transmission
+    unsigned long i2cBytes = 0; //bytes sent on the I2C bus for the LCD (including addresses)
+
+    LcdBuffer(LiquidCrystal_I2C &lcdDevice, byte i2cAddress) : device(lcdDevice), address(i2cAddress) {}
+
+    // Function used to initialize the LCD and the buffer
+    void init() {
+      device.init(); //initialize the LCD
+#if LCD_FAST_MODE
+      Wire.setClock(400000); //I2C fast mode
+#endif
+      device.clear(); //the only real clear, the buffer does the rest
+      memset(cells, ' ', LCD_CELLS); //empty buffer
+      memset(shown, ' ', LCD_CELLS); //empty LCD
+      memset(glyphs, 0, sizeof(glyphs)); //no custom characters loaded yet
+      cursor = 0;
+      lcdCursor = NO_POSITION;
+    }
+
+    // Function used to blank the buffer and position the cursor in the upper-left corner
+    void clear() {
+      memset(cells, ' ', LCD_CELLS);
+      cursor = 0;
+    }
+
+    // Function used to position the cursor in the upper-left corner
+    void home() {
+      cursor = 0;
+    }
+
+    // Function used to position the cursor at a column and row
+    void setCursor(byte col, byte row) {
+      cursor = row * LCD_COLS + col;
+    }
+
+    // Function used to write a character to the buffer, used by all the print functions
+    size_t write(uint8_t value) {
+      if (cursor >= LCD_CELLS) { //outside of the screen
+        return 0;
+      }
+      cells[cursor] = value;
+      cursor = ((cursor % LCD_COLS) == (LCD_COLS - 1)) ? NO_POSITION : (cursor + 1); //like the LCD, do not wrap to the next row
+      return 1;
+    }
+    using Print::write;
+
+    // Function used to load a custom character stored in flash, only if it is not already in that slot
+    void createChar(byte slot, const byte *bitmap) {
+      if (glyphs[slot] != bitmap) {
+        sendByte(0x40 | (slot << 3), 0); //set CGRAM address command
+        for (byte row = 0; row < 8; row++) {
+          sendByte(pgm_read_byte(&bitmap[row]), PIN_RS); //each row is read from flash and sent in the same batch
+        }
+        endBatch();
+        glyphs[slot] = bitmap;
+        lcdCursor = NO_POSITION; //the LCD address counter now points to the CGRAM
+      }
+    }
+
+    // Function used to turn on the backlight
+    void backlight() {
+      device.backlight();
+      backlightBit = PIN_BACKLIGHT;
+      i2cBytes += 2;
+    }
+
+    // Function used to turn off the backlight
+    void noBacklight() {
+      device.noBacklight();
+      backlightBit = 0;
+      i2cBytes += 2;
+    }
+
+    // Function used to send the cells that changed since the last flush, at most maxCells of them so the bus is not held too long
+    void flush(byte maxCells) {
+      for (byte i = 0; (i < LCD_CELLS) && (maxCells != 0); i++) {
+        if (cells[i] == shown[i]) { //nothing to send for this cell
+          continue;
+        }
+        maxCells -= 1;
+        if (lcdCursor != i) { //move the LCD address counter (row 2 starts at 0x40)
+          sendByte(0x80 | ((i < LCD_COLS) ? i : (0x40 + i - LCD_COLS)), 0);
+        }
+        sendByte(cells[i], PIN_RS); //write the character
+        shown[i] = cells[i];
+        lcdCursor = ((i % LCD_COLS) == (LCD_COLS - 1)) ? NO_POSITION : (i + 1); //the counter does not wrap to the next row
+      }
+      endBatch(); //send what is left
+    }
+
+    // Function used to check if every cell has been sent to the LCD
+    bool flushed() {
+      return memcmp(cells, shown, LCD_CELLS) == 0;
+    }
+
+    // Function used to queue a command or character as two 4-bit transfers
+    void sendByte(byte value, byte mode) {
+      if ((pending + 4) > BATCH_SIZE) { //the transmission is full
+        endBatch();
+      }
+      if (pending == 0) { //start a new transmission
+        Wire.beginTransmission(address);
+        i2cBytes += 1; //address byte
+      }
+      byte high = (value & 0xF0) | mode | backlightBit; //upper 4 bits
+      byte low = ((value << 4) & 0xF0) | mode | backlightBit; //lower 4 bits
+      Wire.write(high | PIN_EN); //the LCD reads the data on the falling edge of EN
+      Wire.write(high);
+      Wire.write(low | PIN_EN);
+      Wire.write(low);
+      pending += 4;
+      i2cBytes += 4;
+    }
+
+    // Function used to send the current transmission
+    void endBatch() {
+      if (pending != 0) {
+        Wire.endTransmission();
+        pending = 0;
+      }
+    }
+};
+
+// Number of player stations the board can serve, each with its own LCD and keypad (about 300 bytes of SRAM per station)
+#ifndef STATIONS
+#define STATIONS 1
+#endif
+
+// Set to 1 to start in head-to-head mode: the stations playing the same level get the same questions
+#ifndef HEAD_TO_HEAD
+#define HEAD_TO_HEAD 0
+#endif
+
+// I2C address of the LCD backpack of the first station, the next stations are one address lower each (A0-A2 jumpers of the PCF8574)
+const byte LCD_ADDRESS = 0x27;
+
+// I2C address of the keypad expander of the second station, the next stations are one address higher each (PCF8574A, 0x38-0x3F)
+const byte KEYPAD_EXPANDER_ADDRESS = 0x38;
 
 // Configuring Keypad using keypad library
 const byte ROWS = 4; //four rows
@@ -100,406 +492,2585 @@ Keypad keypad = Keypad( makeKeymap(keys), rowPins, colPins, ROWS, COLS );
 
 // Code for game implementation
 namespace Game {
+// Maximum number of digits the user can type as an answer
+const byte MAX_INPUT = 4;
+
+// Function used to write the digits of a number into a buffer of at least 12 characters, returns the number of characters
+byte formatNumber(char *buffer, int value) {
+  char digits[10]; //digits in reverse order (10 is enough for a 32-bit int on the simulator)
+  byte count = 0;
+  unsigned int n = (value < 0) ? (0U - (unsigned int)value) : (unsigned int)value; //absolute value
+  do {
+    digits[count++] = '0' + (n % 10); //last digit
+    n /= 10;
+  } while (n != 0);
+  byte length = 0;
+  if (value < 0) { //negative numbers start with a minus sign
+    buffer[length++] = '-';
+  }
+  while (count > 0) { //copy the digits in the right order
+    buffer[length++] = digits[--count];
+  }
+  buffer[length] = '\0'; //end of the string
+  return length;
+}
+
+// Function used to write two digits of a number below 100 into a buffer
+inline char *formatTwoDigits(char *buffer, byte value) {
+  buffer[0] = '0' + (value / 10);
+  buffer[1] = '0' + (value % 10);
+  return buffer + 2;
+}
+
+// Function used to write a number of seconds as HH:MM:SS into a buffer of at least 9 characters
+void formatTime(char *buffer, unsigned int totalSecond) {
+  unsigned int minutes = totalSecond / 60; //one division by 60 for minutes and seconds
+  char *p = formatTwoDigits(buffer, (minutes / 60) % 100); //hours (at most 18 for 65535 seconds)
+  *p++ = ':';
+  p = formatTwoDigits(p, minutes % 60); //minutes
+  *p++ = ':';
+  p = formatTwoDigits(p, totalSecond - minutes * 60); //seconds
+  *p = '\0';
+}
+
+// Function used to convert the digits typed by the user into a number
+int parseNumber(const char *digits, byte length) {
+  int value = 0;
+  for (byte i = 0; i < length; i++) {
+    value = value * 10 + (digits[i] - '0'); //add the next digit
+  }
+  return value;
+}
+
+// Function used to add a byte to a CRC-8 (polynomial 0x07)
+inline byte crc8Add(byte crc, byte value) {
+  crc ^= value;
+  for (byte bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+  }
+  return crc;
+}
+
+// Function used to compute the CRC-8 (polynomial 0x07) of a block of bytes
+byte crc8(const byte *data, byte length) {
+  byte crc = 0;
+  while (length--) {
+    crc = crc8Add(crc, *data++);
+  }
+  return crc;
+}
+
+// Number of player profiles (chosen with A, B or C on the difficulty menu)
+const byte SCORE_PROFILES = 3;
+
+// Total scores of every profile, as written in one slot of the EEPROM ring
+struct __attribute__((packed)) ScoreRecord {
+  uint16_t sequence; //incremented on every write, the highest one is the latest record
+  int16_t totals[SCORE_PROFILES]; //total score of each profile
+  byte crc; //CRC-8 of the fields above, a record cut by a power loss is ignored
+};
+
+// Total scores kept as a ring of records over the EEPROM, each game writes the next slot so every cell wears at the same rate
+class ScoreStore
+{
+  public:
+    static const unsigned int RECORD_SIZE = sizeof(ScoreRecord); //9 bytes
+    static const unsigned int SLOTS = 1024 / RECORD_SIZE; //113 slots, each cell is written once every 113 saves
+
+    ScoreRecord current; //latest record
+    unsigned int slot = 0; //slot of the latest record
+    byte pending[RECORD_SIZE]; //record being written
+    byte pendingIndex = RECORD_SIZE; //next byte of the record to write (RECORD_SIZE if nothing to write)
+    unsigned int pendingAddress = 0; //address of the record being written
+    unsigned long writes = 0; //number of records written since power-up
+    bool frozen = false; //during a replay the totals only change in SRAM
+
+    // Function used to find the latest valid record, called once at power-up
+    void begin() {
+      bool found = false;
+      ScoreRecord record;
+      for (unsigned int i = 0; i < SLOTS; i++) { //read every slot
+        EEPROM.get(i * RECORD_SIZE, record);
+        if (crc8((const byte *)&record, RECORD_SIZE - 1) != record.crc) { //empty or damaged slot
+          continue;
+        }
+        if (!found || ((int16_t)(record.sequence - current.sequence) > 0)) { //newer record (the sequence can wrap)
+          current = record;
+          slot = i;
+          found = true;
+        }
+      }
+      if (!found) { //first start, keep the total score written by the previous versions at address 0
+        int16_t oldTotal;
+        EEPROM.get(0, oldTotal);
+        memset(&current, 0, sizeof(current));
+        current.totals[0] = (oldTotal > 0) ? oldTotal : 0; //0xFFFF means the EEPROM was never written
+        slot = SLOTS - 1; //the next record goes to slot 0
+        save();
+      }
+    }
+
+    // Function used to get the total score of a profile
+    int total(byte profile) {
+      return current.totals[profile];
+    }
+
+    // Function used to add the score of a game to a profile, nothing is written if the score is 0
+    void add(byte profile, byte points) {
+      if (points == 0) { //the total did not change
+        return;
+      }
+      current.totals[profile] += points;
+      if (!frozen) {
+        save();
+      }
+    }
+
+    // Function used to queue the latest record for writing in the next slot
+    void save() {
+      current.sequence += 1; //newer than every record in the ring
+      current.crc = crc8((const byte *)&current, RECORD_SIZE - 1);
+      slot = (slot + 1) % SLOTS; //move to the next slot
+      memcpy(pending, &current, RECORD_SIZE);
+      pendingAddress = slot * RECORD_SIZE;
+      pendingIndex = 0; //written by service()
+      writes += 1;
+    }
+
+    // Function used to check if a record is still being written
+    bool busy() const {
+      return pendingIndex < RECORD_SIZE;
+    }
+
+    // Function called on every loop to write one byte of the pending record when the EEPROM is ready (a write takes 3.3 ms)
+    void service() {
+      if ((pendingIndex < RECORD_SIZE) && eepromReady()) {
+        EEPROM.update(pendingAddress + pendingIndex, pending[pendingIndex]); //only written if different
+        pendingIndex += 1;
+      }
+    }
+};
+
+// Total scores of the player profiles, shared by every station
+ScoreStore scores;
+
+// Countdown used for the question timer, only recomputes the displayed value once per second
+class Countdown
+{
+  public:
+    unsigned long startTime = 0; //time the countdown started
+    unsigned long durationMs = 0; //length of the countdown in ms
+    unsigned long nextChange = 0; //elapsed time at which the displayed value changes
+    unsigned int seconds = 0; //length of the countdown in seconds
+    unsigned int shown = 0; //seconds left as last displayed
+    bool running = false; //if the countdown has been started
+
+    // Function used to start the countdown for a number of seconds
+    void start(unsigned int inSeconds) {
+      seconds = inSeconds;
+      durationMs = inSeconds * 1000UL; //only multiplied once per question
+      startTime = millis(); //start counting from now
+      nextChange = 0; //the first value is always displayed
+      running = true;
+    }
+
+    // Function used to stop the countdown
+    void stop() {
+      running = false;
+    }
+
+    // Function used to get the time since the countdown started
+    unsigned long elapsed() {
+      return millis() - startTime;
+    }
+
+    // Function used to check if the countdown has reached zero
+    bool expired() {
+      return running && (elapsed() >= durationMs);
+    }
+
+    // Function used to check if the displayed seconds have changed since the last call
+    bool changed() {
+      if (!running) { //nothing to display
+        return false;
+      }
+      unsigned long now = elapsed(); //time since the countdown started
+      if (now < nextChange) { //same second as before, nothing to redraw
+        return false;
+      }
+      unsigned int passed = now / 1000; //whole seconds passed, computed once per second
+      shown = (passed < seconds) ? (seconds - passed) : 0; //seconds left
+      nextChange = (passed + 1) * 1000UL; //when the next second starts
+      return true;
+    }
+};
+
+// Single-producer/single-consumer queue of key presses, filled by the keypad interrupt and emptied by loop()
+class KeyQueue
+{
+  public:
+    static const byte SIZE = 16; //number of entries, a power of two
+
+    volatile char keys[SIZE]; //keys pressed
+    volatile unsigned long times[SIZE]; //micros() when each key was pressed
+    volatile byte head = 0; //next entry to read, only changed by loop()
+    volatile byte tail = 0; //next entry to write, only changed by the interrupt
+    volatile unsigned int dropped = 0; //keys lost because the queue was full
+
+    // Function used by the interrupt to add a key press, no lock is needed with a single reader and a single writer
+    bool push(char key, unsigned long time) {
+      byte next = (tail + 1) & (SIZE - 1);
+      if (next == head) { //the queue is full
+        dropped += 1;
+        return false;
+      }
+      keys[tail] = key;
+      times[tail] = time;
+      tail = next; //the entry is only visible to loop() once it is complete
+      return true;
+    }
+
+    // Function used by loop() to take the oldest key press, returns false if there is none
+    bool pop(char &key, unsigned long &time) {
+      if (head == tail) { //the queue is empty
+        return false;
+      }
+      key = keys[head];
+      time = times[head];
+      head = (head + 1) & (SIZE - 1); //the entry can be reused by the interrupt
+      return true;
+    }
+};
+
+// Keypad of a station other than the first one, read over the I2C bus through a PCF8574A expander: rows on P0-P3, columns on P4-P7.
+// The bus cannot be used from an interrupt, so the keypad is polled from loop() in the slice of its station.
+class ExpanderKeypad
+{
+  public:
+    static const byte DEBOUNCE_MS = 10; //like the Keypad library, one scan every 10 ms outlasts the bounces of a key
+
+    byte address; //I2C address of the expander
+    uint16_t held = 0; //keys down on the last scan, bit row * 4 + column
+    unsigned long lastScan = 0; //millis() of the last scan
+
+    ExpanderKeypad(byte i2cAddress) : address(i2cAddress) {}
+
+    // Function used to scan the keypad if the debounce time has passed and queue the keys just pressed
+    void poll(KeyQueue &queue) {
+      if ((millis() - lastScan) < DEBOUNCE_MS) {
+        return;
+      }
+      lastScan = millis();
+      uint16_t down = read();
+      uint16_t pressed = down & ~held;
+      held = down;
+      for (byte i = 0; pressed != 0; i++, pressed >>= 1) {
+        if (pressed & 1) {
+          queue.push(keys[i / COLS][i % COLS], micros());
+        }
+      }
+    }
+
+  private:
+    // Function used to drive some rows low and read the columns they pull low, 0 if the expander does not answer
+    byte readColumns(byte rows) {
+      Wire.beginTransmission(address);
+      Wire.write(0xF0 | (~rows & 0x0F)); //a high pin is a weak pull-up, so the columns stay inputs
+      Wire.endTransmission();
+      if (Wire.requestFrom(address, (byte)1) != 1) {
+        return 0;
+      }
+      return (~Wire.read() >> 4) & 0x0F;
+    }
+
+    // Function used to read every key, one write and one read while no key is down
+    uint16_t read() {
+      if (readColumns(0x0F) == 0) { //every row at once
+        return 0;
+      }
+      uint16_t down = 0;
+      for (byte row = 0; row < ROWS; row++) {
+        down |= (uint16_t)readColumns(1 << row) << (row * COLS);
+      }
+      return down;
+    }
+};
+
+// Code sections measured by the profiler
+enum ProbeId : byte {
+  PROBE_PRESENT_LCD, //question printed on the LCD, in the order of Channel
+  PROBE_PRESENT_LED, //question blinked on the blue LED
+  PROBE_PRESENT_SPEAKER, //question buzzed on the speaker
+  PROBE_PRESENT_LED_SPEAKER, //question blinked and buzzed
+  PROBE_CHECK_ANSWER, //checkAnswer()
+  PROBE_DISPLAY_TIMER, //displayTimer()
+  PROBE_KEYPAD_SCAN, //scanKeypad() in the timer interrupt
+  PROBE_LCD_FLUSH, //lcd.flush() in loop()
+  PROBE_COUNT
+};
+
+// Figures counted by the profiler next to the probes, sent as 4-byte values
+enum FigureId : byte {
+  FIGURE_QUESTIONS, //questions whose result has been displayed
+  FIGURE_QUESTION_I2C_BYTES, //LCD I2C bytes sent from a question to the end of its result, summed over the questions
+  FIGURE_QUESTION_I2C_MOST, //most LCD I2C bytes sent for one question
+  FIGURE_WORST_LOOP_US, //longest loop() iteration in microseconds, I2C bus time included
+  FIGURE_STACK_PEAK, //most bytes of SRAM the stack has taken since power-up, found when the frame is sent (0 on Linux)
+  FIGURE_COUNT
+};
+
+// Time spent in the probed sections, histogram of the loop() durations and figures, 180 bytes of SRAM whatever the run time
+class Profiler
+{
+  public:
+    static const byte BUCKETS = 16; //bucket i counts the loop() iterations of [2^i, 2^(i+1)) ticks, the last one also longer ones
+    static const byte FRAME_SIZE = 8 + PROBE_COUNT * 16 + BUCKETS * 2 + FIGURE_COUNT * 4 + 1; //size of the frame sent over the serial port
+    static const byte FRAME_MAGIC = 0xA5; //first byte of a frame
+    static const byte FRAME_TYPE = 'P'; //second byte of a frame, the profile
+    static const byte FRAME_VERSION = 2; //layout of the frame
+
+    // Statistics of one probe
+    struct Stats {
+      unsigned long count; //number of times the section ran
+      unsigned long minTicks; //shortest run
+      unsigned long maxTicks; //longest run
+      unsigned long totalTicks; //time spent in the section, for the mean
+    };
+
+    Stats probes[PROBE_COUNT]; //statistics of each probe
+    unsigned int loops[BUCKETS]; //histogram of the loop() durations
+    unsigned long figures[FIGURE_COUNT]; //figures counted so far
+
+    Profiler() {
+      reset();
+    }
+
+    // Function used to forget everything measured so far
+    void reset() {
+      memset(probes, 0, sizeof(probes));
+      memset(loops, 0, sizeof(loops));
+      memset(figures, 0, sizeof(figures));
+    }
+
+    // Function used to add a run of a probed section
+    void record(byte probe, unsigned long ticks) {
+      Stats &stats = probes[probe];
+      if ((stats.count == 0xFFFFFFFFUL) || (stats.totalTicks + ticks < stats.totalTicks)) { //full, stop so the mean stays right
+        return;
+      }
+      if ((stats.count == 0) || (ticks < stats.minTicks)) {
+        stats.minTicks = ticks;
+      }
+      if (ticks > stats.maxTicks) {
+        stats.maxTicks = ticks;
+      }
+      stats.count += 1;
+      stats.totalTicks += ticks;
+    }
+
+    // Function used to add a loop() iteration to the histogram
+    void recordLoop(unsigned long ticks) {
+      byte bucket = 0;
+      while ((ticks >>= 1) != 0 && (bucket < BUCKETS - 1)) { //log2 of the duration
+        bucket += 1;
+      }
+      if (loops[bucket] == 0xFFFF) { //halve every bucket, the shape of the histogram is kept
+        for (byte i = 0; i < BUCKETS; i++) {
+          loops[i] >>= 1;
+        }
+      }
+      loops[bucket] += 1;
+    }
+
+    // Function used to add a question and the LCD I2C bytes sent for it
+    void recordQuestion(unsigned long i2cBytes) {
+      figures[FIGURE_QUESTIONS] += 1;
+      figures[FIGURE_QUESTION_I2C_BYTES] += i2cBytes;
+      recordMost(FIGURE_QUESTION_I2C_MOST, i2cBytes);
+    }
+
+    // Function used to keep the largest value of a figure
+    void recordMost(byte figure, unsigned long value) {
+      if (value > figures[figure]) {
+        figures[figure] = value;
+      }
+    }
+
+    // Function used to write the profile as a little-endian frame of FRAME_SIZE bytes ending with a CRC-8
+    void frame(byte *out) {
+      byte *p = out;
+      *p++ = FRAME_MAGIC;
+      *p++ = FRAME_TYPE;
+      *p++ = FRAME_VERSION;
+      *p++ = PROBE_COUNT;
+      *p++ = BUCKETS;
+      *p++ = FIGURE_COUNT;
+      p = put(p, PROFILE_TICK_NS, 2);
+      noInterrupts(); //the keypad probe is updated by its interrupt
+      for (byte i = 0; i < PROBE_COUNT; i++) {
+        p = put(p, probes[i].count, 4);
+        p = put(p, probes[i].minTicks, 4);
+        p = put(p, probes[i].maxTicks, 4);
+        p = put(p, probes[i].totalTicks, 4);
+      }
+      interrupts();
+      for (byte i = 0; i < BUCKETS; i++) {
+        p = put(p, loops[i], 2);
+      }
+      for (byte i = 0; i < FIGURE_COUNT; i++) {
+        p = put(p, figures[i], 4);
+      }
+      *p = crc8(out, FRAME_SIZE - 1);
+    }
+
+  private:
+    // Function used to write the low bytes of a value, least significant first
+    static byte *put(byte *p, unsigned long value, byte size) {
+      for (byte i = 0; i < size; i++) {
+        *p++ = (byte)(value >> (8 * i));
+      }
+      return p;
+    }
+};
+
+Profiler profiler; //filled by the probes, sent over the serial port on request
+
+// Measures the time spent until the end of the enclosing scope
+class ScopedProbe
+{
+  public:
+    ScopedProbe(byte probeId) : probe(probeId), start(profileTicks()) {}
+    ~ScopedProbe() {
+      profiler.record(probe, profileTicks() - start);
+    }
+
+  private:
+    byte probe; //probe to record
+    unsigned long start; //time stamp at the start of the scope
+};
+
+// Set to 0 to compile the profiler probes out
+#define PROFILER_ENABLED 1
+
+#if PROFILER_ENABLED
+#define PROFILE_SCOPE(probe) Game::ScopedProbe scopedProbe(probe)
+#else
+#define PROFILE_SCOPE(probe)
+#endif
+
+// Kinds of game events sent over the serial port
+enum EventType : byte {
+  EVENT_QUESTION = 1, //a question is shown and its timer starts
+  EVENT_KEY, //a key is handled by loop()
+  EVENT_ANSWER, //an answer is checked
+  EVENT_GAME_END, //the last answer of a game is checked
+  EVENT_SESSION //bytes of the session being recorded, see SessionLog
+};
+
+// Game events waiting in a ring of fixed-size records, sent in CRC-8 framed batches a byte at a time so logging never waits for
+// the serial port. Frame: 0xA5 'E' version, board id (2), frame number (2), records lost (1), record count (1), records, CRC-8.
+// Record: type, station, millis() (4), then 6 bytes of fields written by question(), key(), answer(), gameEnd() and session(),
+// little-endian.
+class EventLog
+{
+  public:
+    static const byte SLOTS = 8; //records kept until they are sent, a power of two
+    static const byte RECORD_SIZE = 12; //bytes of a record, whatever its type
+    static const byte HEADER_SIZE = 9; //bytes of a frame before the records
+    static const byte BATCH = 4; //records that make a frame worth sending right away
+    static const unsigned int MAX_WAIT_MS = 250; //a smaller batch is sent once its oldest record has waited this long
+    static const byte FRAME_MAGIC = 0xA5; //first byte of a frame, same as the profiler frame
+    static const byte FRAME_TYPE = 'E'; //second byte of a frame, the events
+    static const byte FRAME_VERSION = 1; //layout of the frame and of the records
+    static const unsigned int BOARD_ID_ADDRESS = 1022; //EEPROM address of the board id, after the last score slot
+    static const uint32_t OUTCOME_START = 2166136261UL; //FNV-1a offset basis
+
+    byte records[SLOTS][RECORD_SIZE]; //ring of records
+    byte head = 0; //number of records ever added (the slot is head % SLOTS)
+    byte tail = 0; //number of records ever sent
+    byte lost = 0; //records dropped because the ring was full, sent with the next frame
+    uint16_t board = 0; //identifier of the board, so the streams of several boards can be merged (2 bytes in the EEPROM)
+    unsigned int frames = 0; //number of the next frame, a gap tells the host that frames were lost
+    byte frame[HEADER_SIZE]; //header of the frame being sent
+    byte frameRecords = 0; //records in the frame being sent, 0 if none
+    unsigned int frameIndex = 0; //next byte of the frame to send
+    byte frameCrc = 0; //CRC-8 of the bytes sent so far
+    bool transmitting = false; //if the transmitter still drives PD1
+    uint32_t outcome = OUTCOME_START; //FNV-1a hash of the questions, answers and game ends without their times, a replayed session
+                                      //must give the same value as the recorded one
+
+    // Function used to read the board id from the EEPROM, a new one is drawn from the seed the first time
+    void begin(uint32_t seed) {
+      EEPROM.get(BOARD_ID_ADDRESS, board);
+      if (board == 0xFFFF) { //erased EEPROM
+        board = (unsigned int)(seed ^ (seed >> 16)) & 0x7FFF; //never 0xFFFF again
+        EEPROM.put(BOARD_ID_ADDRESS, board); //only written once in the life of the board
+      }
+    }
+
+    // Function used to log a question: level (0-based), operation (0 '+', 1 '-', 2 'x', 3 '/'), operands and answer
+    void question(byte station, byte level, byte op, byte num1, byte num2, unsigned int answer) {
+      byte data[6] = {level, op, num1, num2, (byte)answer, (byte)(answer >> 8)};
+      add(EVENT_QUESTION, station, data);
+    }
+
+    // Function used to log a key and the game phase it was pressed in
+    void key(byte station, char value, byte phase) {
+      byte data[6] = {(byte)value, phase, 0, 0, 0, 0};
+      add(EVENT_KEY, station, data);
+    }
+
+    // Function used to log a checked answer: profile, operation with bit 6 set on a timeout and bit 7 if correct, the typed number
+    // (0xFFFF if nothing was typed) and the time taken to answer in ms
+    void answer(byte station, byte profile, byte op, bool correct, bool timeout, unsigned int typed, unsigned int responseMs) {
+      byte flags = op | (timeout ? 0x40 : 0) | (correct ? 0x80 : 0);
+      byte data[6] = {profile, flags, (byte)typed, (byte)(typed >> 8), (byte)responseMs, (byte)(responseMs >> 8)};
+      add(EVENT_ANSWER, station, data);
+    }
+
+    // Function used to log the end of a game: profile, level (0-based), score and number of questions
+    void gameEnd(byte station, byte profile, byte level, byte score, byte questions) {
+      byte data[6] = {profile, level, score, questions, 0, 0};
+      add(EVENT_GAME_END, station, data);
+    }
+
+    // Function used to log up to 5 bytes of the session being recorded: their count, bit 6 set if every input so far has been logged
+    // (the host may end the session there) and bit 7 on the first bytes of a session
+    void session(const byte *bytes, byte length, bool synced, bool first) {
+      byte data[6] = {(byte)(length | (synced ? 0x40 : 0) | (first ? 0x80 : 0)), 0, 0, 0, 0, 0};
+      memcpy(data + 1, bytes, length);
+      add(EVENT_SESSION, 0, data);
+    }
+
+    // Function used to check if records or a frame are still waiting for the serial port
+    bool busy() {
+      return (head != tail) || transmitting;
+    }
+
+    // Function called on every loop to send the records, a frame starts when a batch is full, when its oldest record has waited
+    // MAX_WAIT_MS or right away if now is true; only the bytes the transmit buffer takes at once are written
+    void service(bool now) {
+      if (frameRecords == 0) {
+        if (transmitting && uartRelease()) { //the last frame has left, PD1 goes back to the IR sensor
+          transmitting = false;
+        }
+        byte waiting = head - tail;
+        if ((waiting == 0) || (!now && (waiting < BATCH) && (millis() - recordTime(tail) < MAX_WAIT_MS))) {
+          return;
+        }
+        start(waiting);
+      }
+      unsigned int size = HEADER_SIZE + frameRecords * RECORD_SIZE + 1;
+      while (frameIndex < size) {
+        byte value = frameByte(size);
+        if (!uartWrite(value)) { //the transmit buffer is full, the rest goes on the next loop
+          return;
+        }
+        frameCrc = crc8Add(frameCrc, value);
+        frameIndex += 1;
+      }
+      tail += frameRecords; //the slots can be used again
+      frameRecords = 0;
+    }
+
+    // Function used to finish the frame being sent, waiting for the serial port (before another frame is sent)
+    void flush() {
+      while (frameRecords != 0) {
+        service(false);
+      }
+    }
+
+  private:
+    // Function used to add a record to the ring and its fields to the outcome, even if the ring is full
+    void add(byte type, byte station, const byte *data) {
+      if ((type == EVENT_QUESTION) || (type == EVENT_ANSWER) || (type == EVENT_GAME_END)) {
+        byte fields = (type == EVENT_ANSWER) ? 4 : 6; //the response time depends on the timing of the keys
+        hash(type);
+        hash(station);
+        for (byte i = 0; i < fields; i++) {
+          hash(data[i]);
+        }
+      }
+      if ((byte)(head - tail) == SLOTS) { //the serial port is not keeping up
+        if (lost < 0xFF) {
+          lost += 1;
+        }
+        return;
+      }
+      byte *p = records[head % SLOTS];
+      head += 1;
+      p[0] = type;
+      p[1] = station;
+      put(p + 2, millis(), 4);
+      memcpy(p + 6, data, RECORD_SIZE - 6);
+    }
+
+    // Function used to add a byte to the outcome hash
+    void hash(byte value) {
+      outcome = (outcome ^ value) * 16777619UL; //FNV-1a prime
+    }
+
+    // Function used to get the time a record was added
+    unsigned long recordTime(byte index) {
+      const byte *p = records[index % SLOTS] + 2;
+      return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+    }
+
+    // Function used to write the header of a frame holding the waiting records
+    void start(byte count) {
+      byte *p = frame;
+      *p++ = FRAME_MAGIC;
+      *p++ = FRAME_TYPE;
+      *p++ = FRAME_VERSION;
+      p = put(p, board, 2);
+      p = put(p, frames, 2);
+      *p++ = lost;
+      *p = count;
+      frames += 1;
+      lost = 0;
+      frameRecords = count;
+      frameIndex = 0;
+      frameCrc = 0;
+      if (!transmitting) {
+        uartClaim(); //TX takes PD1 over until the frame has left
+        transmitting = true;
+      }
+    }
+
+    // Function used to get the byte of the frame at frameIndex
+    byte frameByte(unsigned int size) {
+      if (frameIndex < HEADER_SIZE) {
+        return frame[frameIndex];
+      }
+      if (frameIndex == size - 1) {
+        return frameCrc;
+      }
+      unsigned int offset = frameIndex - HEADER_SIZE;
+      return records[(byte)(tail + offset / RECORD_SIZE) % SLOTS][offset % RECORD_SIZE];
+    }
+
+    // Function used to write the low bytes of a value, least significant first
+    static byte *put(byte *p, unsigned long value, byte size) {
+      for (byte i = 0; i < size; i++) {
+        *p++ = (byte)(value >> (8 * i));
+      }
+      return p;
+    }
+};
+
+static_assert(ScoreStore::SLOTS * ScoreStore::RECORD_SIZE <= EventLog::BOARD_ID_ADDRESS, "the board id overlaps the score slots");
+
+// Game events of every station, sent over the serial port in the background
+EventLog events;
+
+// Inputs of a recorded session: the keys in the order of SESSION_KEYS, then the IR sensor edges and the end of the session
+const char SESSION_KEYS[] PROGMEM = "0123456789ABCD*#";
+enum SessionInput : byte {
+  INPUT_IR_ON = 16, //an object came in front of the IR sensor
+  INPUT_IR_OFF, //the object left
+  INPUT_END = 31 //end of the session, only written by the host
+};
+
+// Function used to get the session input of a key
+inline byte sessionInput(char key) {
+  if ((key >= '0') && (key <= '9')) {
+    return key - '0';
+  }
+  if ((key >= 'A') && (key <= 'D')) {
+    return 10 + (key - 'A');
+  }
+  return (key == '*') ? 14 : 15;
+}
+
+// Inputs of the game recorded from power-up so a session can be replayed exactly. A session is a 16-byte header (version, station
+// count, seed drawn by setup(), the 3 total scores, millis() at the end of setup()) followed by one entry per input: the ms since the
+// previous entry as a varint (7 bits per byte, least significant first, bit 7 set when another byte follows), then the station in
+// bits 5-7 and the input in bits 0-4. The board sends it in EVENT_SESSION records and host/session.cpp cuts it out of the event
+// stream. A replay starts with 'L': the board asks for bytes with 0xA5 'N' room CRC-8 frames, the host answers with a chunk (length,
+// bytes, CRC-8 of both; length 0 once everything is sent) and the board ends with 0xA5 'D' version status outcome (4) inputs (2) CRC-8.
+class SessionLog
+{
+  public:
+    static const byte VERSION = 1; //layout of the session and of the replay frames
+    static const byte HEADER_SIZE = 16; //bytes of the session header
+    static const byte CHUNK_BYTES = 5; //session bytes per EVENT_SESSION record
+    static const byte BUFFER = 16; //replayed bytes kept ahead, a power of two
+    static const byte REQUEST = 8; //most bytes asked for at once
+    static const unsigned int TIMEOUT_MS = 1000; //time the host has to answer a request
+    static const byte DONE_SIZE = 11; //bytes of the 'D' frame
+
+    // Results of a replay sent in the 'D' frame
+    enum Status : byte {
+      REPLAY_OK, //every input was replayed
+      REPLAY_CORRUPT, //a chunk had a wrong CRC or the session is not a valid one
+      REPLAY_STATIONS, //the session was recorded with another number of stations or another version
+      REPLAY_TIMEOUT, //the host stopped answering
+      REPLAY_BUSY //a game was being played, the replay did not start
+    };
+
+    // Steps of the reception of a chunk
+    enum Receive : byte {
+      RECEIVE_LENGTH, //the next byte is the length of a chunk
+      RECEIVE_DATA, //bytes of the chunk
+      RECEIVE_CRC //CRC-8 of the chunk
+    };
+
+    bool recording = false; //if the inputs are recorded
+    byte chunk[CHUNK_BYTES]; //session bytes not logged yet
+    byte chunkLength = 0; //number of bytes in chunk
+    bool firstChunk = false; //if the next chunk starts a session
+    bool synced = true; //if every recorded input has been logged in a chunk marked as synced
+    unsigned long lastInput = 0; //millis() of the last recorded input
+
+    bool replaying = false; //if the inputs come from a replayed session
+    bool started = false; //if the header of the replayed session has been applied
+    byte buffer[BUFFER]; //replayed bytes received and not parsed yet
+    byte head = 0; //number of bytes ever received in checked chunks
+    byte tail = 0; //number of bytes ever parsed
+    byte receive = RECEIVE_LENGTH; //step of the chunk being received
+    byte chunkSize = 0; //length of the chunk being received
+    byte chunkReceived = 0; //bytes of the chunk received so far
+    byte chunkCrc = 0; //CRC-8 of the chunk received so far
+    bool requested = false; //if the board waits for a chunk
+    unsigned long requestedAt = 0; //millis() when the last chunk was asked for
+    bool ended = false; //if the host has sent everything
+    unsigned long origin = 0; //millis() when the replayed session started
+    unsigned long nextAt = 0; //time of the next input since the start of the session
+    byte nextInput = 0; //station and input of the next entry
+    bool haveNext = false; //if nextAt and nextInput hold an entry not replayed yet
+    unsigned long delta = 0; //time of the entry being parsed
+    byte shift = 0; //bits of delta parsed so far
+    unsigned int inputs = 0; //inputs replayed
+
+    // Function used to start recording with the state setup() left the game in
+    void begin(uint32_t seed, byte stations, const ScoreRecord &saved) {
+      recording = true;
+      firstChunk = true;
+      chunkLength = 0;
+      lastInput = millis();
+      append(VERSION);
+      append(stations);
+      appendValue(seed, 4);
+      for (byte i = 0; i < SCORE_PROFILES; i++) {
+        appendValue((uint16_t)saved.totals[i], 2);
+      }
+      appendValue(lastInput, 4);
+    }
+
+    // Function used to record an input of a station
+    void input(byte station, byte value) {
+      if (!recording) {
+        return;
+      }
+      unsigned long now = millis();
+      unsigned long gap = now - lastInput; //delta-encoded, most gaps fit in 1 or 2 bytes
+      lastInput = now;
+      do {
+        byte low = gap & 0x7F;
+        gap >>= 7;
+        append(low | ((gap != 0) ? 0x80 : 0));
+      } while (gap != 0);
+      append((station << 5) | value);
+    }
+
+    // Function used to log the bytes not logged yet, called when nobody plays: the host can end the session at this point
+    void sync() {
+      if (!synced) {
+        logChunk(true);
+        synced = true;
+      }
+    }
+
+    // Function used to start a replay, the recording stops until the replay has ended and nobody plays
+    void startReplay() {
+      sync();
+      recording = false;
+      replaying = true;
+      started = false;
+      head = tail = 0;
+      receive = RECEIVE_LENGTH;
+      requested = false;
+      ended = false;
+      haveNext = false;
+      nextAt = 0;
+      delta = 0;
+      shift = 0;
+      inputs = 0;
+    }
+
+    // Function used to get the number of checked bytes not parsed yet
+    byte available() {
+      return head - tail;
+    }
+
+    // Function used to read the header of the replayed session once it has arrived, returns false until then
+    bool header(byte &version, byte &stations, uint32_t &seed, int16_t *totals) {
+      if (available() < HEADER_SIZE) {
+        return false;
+      }
+      version = take();
+      stations = take();
+      seed = takeValue(4);
+      for (byte i = 0; i < SCORE_PROFILES; i++) {
+        totals[i] = (int16_t)takeValue(2);
+      }
+      takeValue(4); //millis() of the recording board, only used by the host
+      started = true;
+      origin = millis();
+      return true;
+    }
+
+    // Function used to take the next input of the replayed session once its time has come, returns false if there is none yet
+    bool next(byte &station, byte &value) {
+      while (!haveNext && (available() != 0)) { //parse the next entry
+        byte b = take();
+        if (shift != 0xFF) { //still in the varint
+          delta |= (unsigned long)(b & 0x7F) << shift;
+          shift = (b & 0x80) ? (shift + 7) : 0xFF;
+        } else {
+          nextAt += delta;
+          nextInput = b;
+          haveNext = true;
+          delta = 0;
+          shift = 0;
+        }
+      }
+      if (!haveNext || (millis() - origin < nextAt)) {
+        return false;
+      }
+      haveNext = false;
+      station = nextInput >> 5;
+      value = nextInput & 0x1F;
+      inputs += 1;
+      return true;
+    }
+
+    // Function used to check if the host has sent everything and it has been replayed, without an end entry
+    bool exhausted() {
+      return ended && !haveNext && (available() == 0);
+    }
+
+    // Function used to take a byte sent by the host during a replay, returns false if the chunk is damaged
+    bool accept(byte value) {
+      switch (receive) {
+        case (RECEIVE_LENGTH):
+          if (value > BUFFER - available()) { //more than asked for
+            return false;
+          }
+          chunkSize = value;
+          chunkReceived = 0;
+          chunkCrc = crc8Add(0, value);
+          receive = (value == 0) ? RECEIVE_CRC : RECEIVE_DATA;
+          break;
+        case (RECEIVE_DATA):
+          buffer[(byte)(head + chunkReceived) % BUFFER] = value; //only visible once the CRC is checked
+          chunkCrc = crc8Add(chunkCrc, value);
+          chunkReceived += 1;
+          if (chunkReceived == chunkSize) {
+            receive = RECEIVE_CRC;
+          }
+          break;
+        case (RECEIVE_CRC):
+          if (value != chunkCrc) {
+            return false;
+          }
+          head += chunkSize;
+          ended = (chunkSize == 0);
+          requested = false;
+          receive = RECEIVE_LENGTH;
+          break;
+      }
+      return true;
+    }
+
+    // Function used to ask the host for the next chunk (REQUEST bytes at most) when there is room for it, returns false if the host
+    // does not answer
+    bool service() {
+      if (requested) {
+        return millis() - requestedAt < TIMEOUT_MS;
+      }
+      byte room = BUFFER - available();
+      if (!ended && (room >= REQUEST)) {
+        byte frame[4] = {EventLog::FRAME_MAGIC, 'N', REQUEST, 0};
+        frame[3] = crc8(frame, 3);
+        events.flush(); //an event frame being sent is finished first
+        uartSend(frame, sizeof(frame));
+        requested = true;
+        requestedAt = millis();
+      }
+      return true;
+    }
+
+    // Function used to end the replay and send the 'D' frame
+    void finish(byte status) {
+      byte frame[DONE_SIZE] = {EventLog::FRAME_MAGIC, 'D', VERSION, status};
+      for (byte i = 0; i < 4; i++) {
+        frame[4 + i] = (byte)(events.outcome >> (8 * i));
+      }
+      frame[8] = (byte)inputs;
+      frame[9] = (byte)(inputs >> 8);
+      frame[10] = crc8(frame, DONE_SIZE - 1);
+      events.flush(); //an event frame being sent is finished first
+      uartSend(frame, sizeof(frame));
+      replaying = false;
+    }
+
+  private:
+    // Function used to log the bytes of chunk
+    void logChunk(bool inputsLogged) {
+      events.session(chunk, chunkLength, inputsLogged, firstChunk);
+      firstChunk = false;
+      chunkLength = 0;
+    }
+
+    // Function used to add a byte to the session being recorded
+    void append(byte value) {
+      chunk[chunkLength++] = value;
+      synced = false;
+      if (chunkLength == CHUNK_BYTES) {
+        logChunk(false);
+      }
+    }
+
+    // Function used to add the low bytes of a value, least significant first
+    void appendValue(unsigned long value, byte size) {
+      for (byte i = 0; i < size; i++) {
+        append((byte)(value >> (8 * i)));
+      }
+    }
+
+    // Function used to take the next replayed byte
+    byte take() {
+      return buffer[tail++ % BUFFER];
+    }
+
+    // Function used to take a little-endian value from the replayed bytes
+    unsigned long takeValue(byte size) {
+      unsigned long value = 0;
+      for (byte i = 0; i < size; i++) {
+        value |= (unsigned long)take() << (8 * i);
+      }
+      return value;
+    }
+};
+
+// Recorder and replayer of the inputs of every station
+SessionLog session;
+
+// Xorshift32 generator with unbiased bounded draws, no division or modulo on the 8-bit core
+class Random
+{
+  public:
+    static const uint32_t DEFAULT_STATE = 2463534242UL; //any value but 0, which xorshift never leaves
+
+    uint32_t state = DEFAULT_STATE; //current state
+
+    // Function used to seed the generator, every value gives a different sequence
+    void seed(uint32_t value) {
+      state = mix(value);
+      if (state == 0) {
+        state = DEFAULT_STATE;
+      }
+    }
+
+    // Function used to get the next 32 random bits
+    uint32_t next() {
+      uint32_t x = state;
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      state = x;
+      return x;
+    }
+
+    // Function used to draw a number in [0, n), n > 0: values above n are drawn again, so every value is equally likely
+    uint16_t below(uint16_t n) {
+      uint16_t mask = n - 1; //smallest 2^k - 1 that covers n - 1, less than 2 draws are needed on average
+      mask |= mask >> 1;
+      mask |= mask >> 2;
+      mask |= mask >> 4;
+      mask |= mask >> 8;
+      uint16_t value;
+      do {
+        value = (uint16_t)(next() >> 16) & mask; //the upper bits, shifting by 16 is only a register move on the AVR
+      } while (value >= n);
+      return value;
+    }
+
+    // Function used to draw a number in [low, high), like random(low, high)
+    int between(int low, int high) {
+      return low + below(high - low);
+    }
+
+    // Function used to spread the bits of a value over the whole word (MurmurHash3 finalizer)
+    static uint32_t mix(uint32_t x) {
+      x ^= x >> 16;
+      x *= 0x85EBCA6BUL;
+      x ^= x >> 13;
+      x *= 0xC2B2AE35UL;
+      x ^= x >> 16;
+      return x;
+    }
+};
+
+// Question packed in 4 bytes, the deck of a whole game fits in 40 bytes of SRAM
+struct __attribute__((packed)) Question
+{
+  byte num1; //first operand [1, 99]
+  byte num2; //second operand [1, 99]
+  static const int MAX_ANSWER = 511; //largest value the answer field holds
+
+  uint16_t answer : 9; //correct value, at most 99 + 99 or 19 x 19
+  uint16_t op : 2; //operation (0 '+', 1 '-', 2 'x', 3 '/')
+  uint16_t width : 5; //characters of "num1 op num2 =" on the LCD
+};
+static_assert(sizeof(Question) == 4, "a question must stay packed in 4 bytes");
+
+// Characters of the operations, indexed by Question::op
+const char OPERATIONS[] PROGMEM = "+-x/";
+
+// Questions of a game, drawn before the game starts so moving to the next one is only an index bump
+class QuestionDeck
+{
+  public:
+    static const byte SIZE = 10; //questions per game
+    static const byte RETRIES = 8; //draws tried before a duplicate is accepted
+
+    Question cards[SIZE]; //questions in the order they are asked
+    byte count = 0; //number of questions in the deck
+    byte next = 0; //next question to ask
+    byte duplicates = 0; //questions kept although they already were in the deck
+
+    // Function used to empty the deck before a new game
+    void clear() {
+      count = 0;
+      next = 0;
+      duplicates = 0;
+    }
+
+    // Function used to check if a question is already in the deck
+    bool contains(const Question &question) const {
+      for (byte i = 0; i < count; i++) {
+        if ((cards[i].op == question.op) && (cards[i].num1 == question.num1) && (cards[i].num2 == question.num2)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Function used to add a question at the end of the deck
+    void add(const Question &question) {
+      if (count < SIZE) {
+        cards[count++] = question;
+      }
+    }
+
+    // Function used to take the next question, the deck must not be empty
+    const Question &draw() {
+      return cards[next++];
+    }
+};
+
+// Blink/buzz pattern: groups of pulses, each followed by a silence, e.g. "num1 pulses, 1 s gap, num2 pulses, 1 s gap"
+struct PulseScript
+{
+  static const byte MAX_GROUPS = 4; //maximum number of groups
+
+  byte square = 0; //bits of PORTB toggled at 1 kHz while on (speaker) instead of held high (LED)
+  unsigned int onMs = 0; //length of a blink/buzz
+  unsigned int offMs = 0; //silence between two pulses of the same group
+  byte groups = 0; //number of groups
+  byte outputs[MAX_GROUPS]; //bits of PORTB switched by the pulses of each group (BluePin::MASK, SpeakerPin::MASK)
+  byte pulses[MAX_GROUPS]; //number of pulses of each group
+  unsigned int gapMs[MAX_GROUPS]; //silence after each group
+
+  PulseScript() {}
+  PulseScript(byte squareBits, unsigned int pulseMs, unsigned int silenceMs)
+    : square(squareBits), onMs(pulseMs), offMs(silenceMs) {}
+
+  // Function used to add a group of pulses on some outputs followed by a silence
+  PulseScript &add(byte output, byte count, unsigned int silenceMs) {
+    if (groups < MAX_GROUPS) {
+      outputs[groups] = output;
+      pulses[groups] = count;
+      gapMs[groups] = silenceMs;
+      groups += 1;
+    }
+    return *this;
+  }
+
+  // Function used to get every bit of PORTB the script may switch
+  byte allOutputs() const {
+    byte bits = 0;
+    for (byte i = 0; i < groups; i++) {
+      bits |= outputs[i];
+    }
+    return bits;
+  }
+};
+
+// Plays a pulse script on the blue LED or the speaker from a 2 kHz timer interrupt, so the timing does not depend on loop()
+class PulseSequencer
+{
+  public:
+    static const unsigned int TICKS_PER_MS = 2; //one tick every 0.5 ms, a 1 kHz tone toggles the speaker on every tick
+    typedef void (*Callback)(void *context); //function called from loop() once a script has finished
+
+    PulseScript script; //script being played
+    volatile bool playing = false; //if the interrupt is playing the script
+    volatile bool finished = false; //if the script has ended and the callback has not been called yet
+    volatile unsigned int ticksLeft = 0; //ticks until the output changes again
+    unsigned int onTicks = 0; //length of a pulse in ticks
+    unsigned int offTicks = 0; //silence between two pulses in ticks
+    byte group = 0; //group being played
+    byte pulsesLeft = 0; //pulses left in the group
+    bool on = false; //if the output is on
+    byte output = 0; //bits of PORTB switched by the current pulse
+    byte toggle = 0; //bits of PORTB toggled at 1 kHz during the current pulse
+    Callback onDone = 0; //called by service() when the script has ended
+    void *context = 0; //passed to the callback
+
+    // Function used to start playing a script, done(doneContext) is called from loop() once it has ended
+    void play(const PulseScript &newScript, Callback done, void *doneContext) {
+      stop(); //the interrupt is off while the script is replaced
+      script = newScript;
+      onDone = done;
+      context = doneContext;
+      onTicks = (script.onMs != 0) ? (script.onMs * TICKS_PER_MS) : 1;
+      offTicks = script.offMs * TICKS_PER_MS;
+      group = 0;
+      pulsesLeft = (script.groups != 0) ? script.pulses[0] : 0;
+      if (usesSpeaker()) { //a beep would be counted as a buzz
+        stopTone();
+      }
+      playing = true;
+      next(); //the first pulse starts right away
+      if (playing) {
+        startPulseTimer();
+      }
+    }
+
+    // Function used to stop playing and turn the output off, the callback is not called
+    void stop() {
+      stopPulseTimer();
+      playing = false;
+      finished = false;
+      on = false;
+      PortB::clear(script.allOutputs()); //LED/speaker off, the tone interrupt toggles PB5 on the same port
+    }
+
+    // Function used to stop playing if the script being played was started for owner
+    void release(void *owner) {
+      if (context == owner) {
+        stop();
+      }
+    }
+
+    // Function used to check if a new script can be played without cutting another one
+    bool idle() const {
+      return !playing && !finished;
+    }
+
+    // Function used to check if the script being played buzzes the speaker, no tone may start meanwhile
+    bool usesSpeaker() const {
+      return (script.allOutputs() & SpeakerPin::MASK) != 0;
+    }
+
+    // Function called from the timer interrupt every 0.5 ms
+    void tick() {
+      if (!playing) {
+        return;
+      }
+      if (on && (toggle != 0)) { //1 kHz square wave on the speaker
+        PortB::toggle(toggle);
+      }
+      ticksLeft -= 1;
+      if (ticksLeft == 0) { //time to switch the output
+        next();
+      }
+    }
+
+#ifdef SPEEDMATH_HOST
+    // Function used by the simulator to play up to count ticks at once, the same as count calls of tick() but it stops after the one
+    // that switches the output; returns the ticks played. Only the parity of the 1 kHz toggles matters in between.
+    unsigned long ticks(unsigned long count) {
+      if (!playing) {
+        return count;
+      }
+      unsigned long quiet = (count < ticksLeft) ? count : (ticksLeft - 1); //ticks that only toggle the speaker
+      if (on && (toggle != 0) && (quiet & 1)) {
+        PortB::toggle(toggle);
+      }
+      ticksLeft -= quiet;
+      if (quiet == count) {
+        return count;
+      }
+      tick(); //the tick that switches the output
+      return quiet + 1;
+    }
+#endif
+
+    // Function called on every loop to run the callback once the script has ended, outside of the interrupt
+    void service() {
+      if (finished) {
+        finished = false;
+        if (onDone != 0) {
+          onDone(context);
+        }
+      }
+    }
+
+  private:
+    // Function used to move to the next pulse or silence of the script
+    void next() {
+      if (on) { //a pulse has just finished
+        PortB::clear(output); //LED/speaker off
+        on = false;
+        pulsesLeft -= 1;
+        ticksLeft = (pulsesLeft > 0) ? offTicks : endGroup(); //silence before the next pulse or the next group
+        if (ticksLeft != 0) {
+          return;
+        }
+      }
+      while (pulsesLeft == 0) { //the group is over, empty groups only add their silence
+        if (group >= script.groups) { //the whole script has been played
+          stopPulseTimer();
+          playing = false;
+          finished = true;
+          return;
+        }
+        ticksLeft = endGroup();
+        if (ticksLeft != 0) {
+          return;
+        }
+      }
+      output = script.outputs[group];
+      toggle = output & script.square;
+      PortB::set(output); //LED/speaker on
+      on = true;
+      ticksLeft = onTicks;
+    }
+
+    // Function used to move to the next group, returns the silence after the current one in ticks
+    unsigned int endGroup() {
+      unsigned int silence = script.gapMs[group] * TICKS_PER_MS;
+      group += 1;
+      pulsesLeft = (group < script.groups) ? script.pulses[group] : 0;
+      return silence;
+    }
+};
+
+// Blinks/buzzes of every station, there is only one blue LED and one speaker so the stations take turns
+PulseSequencer pulses;
+
+// Ways of showing the operands of a question, in the order of the PROBE_PRESENT_* probes
+enum Channel : byte {
+  CHANNEL_LCD, //printed on the LCD
+  CHANNEL_LED, //blinked on the blue LED
+  CHANNEL_SPEAKER, //buzzed on the speaker
+  CHANNEL_LED_SPEAKER //num1 blinked on the blue LED, num2 buzzed on the speaker
+};
+
+// Operands [low, high) drawn for an operation
+struct OperandRange {
+  byte low; //smallest operand
+  byte high; //first operand above the range
+};
+
+// Everything that makes a level, only read at compile time: LevelCode turns each entry into its own code
+struct LevelDesc {
+  char letter; //letter shown next to the key of the level on the difficulty menu
+  OperandRange ranges[4]; //operands of '+', '-', 'x' and '/', the second operand of '-' and '/' is at most the first one
+  byte timerSeconds; //time to answer a question
+  Channel channel; //how the operands are shown
+  unsigned int pulseMs; //length of a blink/buzz
+  unsigned int silenceMs; //silence between two blinks/buzzes of the same number
+  byte questions; //questions per game
+};
+
+// Levels of the game, chosen with keys 1, 2, 3... on the difficulty menu, a new level is a new line
+constexpr LevelDesc LEVELS[] = {
+  {'E', {{1, 100}, {1, 100}, {1, 20}, {1, 100}}, 20, CHANNEL_LCD, 0, 0, 10}, //easy: the question is printed
+  {'M', {{1, 10}, {1, 10}, {1, 10}, {1, 10}}, 15, CHANNEL_LED, 250, 250, 10}, //medium: 250 ms blinks, 250 ms apart
+  {'H', {{1, 10}, {1, 10}, {1, 10}, {1, 10}}, 10, CHANNEL_SPEAKER, 250, 200, 10}, //hard: 1 kHz buzzes, 200 ms apart
+  {'X', {{1, 10}, {1, 10}, {1, 10}, {1, 10}}, 10, CHANNEL_LED_SPEAKER, 250, 200, 10} //mixed: num1 blinks, num2 buzzes
+};
+const byte LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]); //number of levels
+static_assert(LEVEL_COUNT <= 4, "the difficulty menu has room for 4 levels");
+
+class SpeedMath;
+
+// Code and settings of a level, made by LevelCode from LEVELS and kept in flash
+struct LevelOps {
+  void (*buildDeck)(SpeedMath &game); //draws the questions of a game
+  void (*present)(SpeedMath &game); //shows the next question
+  void (*generateNumbers)(SpeedMath &game); //draws the numbers of one question
+  byte timerSeconds; //time to answer a question
+  byte questions; //questions per game
+  char letter; //letter on the difficulty menu
+};
+
+// Code of every level, in the order of LEVELS
+struct LevelTable {
+  LevelOps levels[LEVEL_COUNT];
+};
+extern const LevelTable LEVEL_TABLE PROGMEM;
+
+// Head-to-head mode: every station that chooses the same level during a match gets the same questions
+bool headToHead = HEAD_TO_HEAD;
+uint32_t matchSeed = 0; //drawn when a match starts, that is when the IR sensor wakes stations that were all idle
+
 class SpeedMath
 {
   public:
-    String input = ""; //used to get a string of number inputs from the user
+    // Steps of the game flow, each one is left when its deadline passes or a key is pressed
+    enum Phase : byte {
+      PHASE_IDLE, //waiting for the IR sensor
+      PHASE_INTRO, //"Hello!" is displayed with the green LED on
+      PHASE_LEVEL_SELECT, //waiting for the user to choose a level
+      PHASE_LEVEL_DELAY, //short pause after a level is chosen
+      PHASE_STIMULUS, //"Look/Listen carefully!" message followed by the blinks or buzzes
+      PHASE_ANSWERING, //the timer is running and the user types an answer
+      PHASE_FEEDBACK, //"Correct!" or "Incorrect!" is displayed
+      PHASE_SCORE, //the game score is displayed
+      PHASE_TOTAL, //the total score is displayed until the game is stopped
+      PHASE_GOODBYE //"Good Bye!" is displayed before going back to idle
+    };
+
+    char input[MAX_INPUT]; //digits typed by the user
+    byte inputLength = 0; //number of digits typed by the user
     int num1, num2, correctValue, op; //initialization of int type
-    String operation = ""; //type of operation used in the game ("+", "-", "*", or "/")
+    char operation = '+'; //type of operation used in the game ('+', '-', 'x', or '/')
     int numChar = 0; //used for determining the number of characters used in typing a question
 
-    char difficulty; //level of difficuty chosen by the user (1-E, 2-M, or 3-H)
-    byte score = 0; //score is initially 0
-    byte numQuestions = 10; //number of questioned asked, max is 255
-    bool playMode = false; //if user is in play mode
-    bool isExited = false; //if the game has already been exited
-    bool levelChosen = false; //if the level is chosen by the user
-    bool setUp = false; //if the game has already been exited
-    bool gameStopped = false; //if the game has been stopped
-    unsigned long delayStart = 0; //time the delay started
-    bool delayRunning = false; //true if still waiting for delay to finish
-    int totScore = 0; //total score of the player
-    int addTotScore = 0; //address of the total score
-
-    // Function used to generate random questions for the easy level game
-    void generateEasy(void) {
-      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-      generateNumbers(1, 100, 1, 100, 1, 20, 1, 100); //the range of randomly generated numbers
-      lcd.print(String(num1) + operation + String(num2) + "="); //print the question to the LCD
-      numChar = countDigit(num1) + countDigit(num2) + 2; //count the number of characters displayed on the LCD
-      delayStart = millis(); //start delay
-      delayRunning = true; //delay is not finished yet
+    char difficulty; //level of difficuty chosen by the user (1-E, 2-M, 3-H, or 4-X)
+    LevelOps level; //code and settings of the chosen level, copied from LEVEL_TABLE
+    byte score = 0; //score is initially 0
+    byte numQuestions = 0; //number of questions left to ask
+    bool playMode = false; //if user is in play mode
+    bool setUp = false; //if the game has already been set up
+    byte phase = PHASE_IDLE; //current step of the game flow
+    unsigned long phaseStart = 0; //time the current phase started
+    unsigned long phaseLength = 0; //duration of the current phase in ms (0 if it waits for a key)
+    Random rng; //draws the questions
+    QuestionDeck deck; //questions of the current game, drawn when the level is chosen
+    PulseScript stimulus; //blinks/buzzes of the current medium/hard question
+    Countdown timer; //timer of the current question
+    unsigned long questionI2cStart = 0; //LCD I2C byte count when the current question started
+    byte profile = 0; //player profile (0-A, 1-B, 2-C)
+    byte matchPlays[LEVEL_COUNT] = {}; //games of each level started in the current match, the n-th one gets the same deck everywhere
+    LcdBuffer &lcd; //LCD of the station the game is played on
+    byte station; //index of the station, sent with the events of the game
+
+    SpeedMath(LcdBuffer &display, byte index = 0) : lcd(display), station(index) {}
+
+    // Function used to move to another phase of the game for a given duration
+    void setPhase(byte nextPhase, unsigned long duration) {
+      phase = nextPhase; //change the current phase
+      phaseStart = millis(); //start counting from now
+      phaseLength = duration; //time before the phase ends
+    }
+
+    // Function used to check if the duration of the current phase has passed
+    bool phaseElapsed() {
+      return (phaseLength != 0) && ((millis() - phaseStart) >= phaseLength);
+    }
+
+    // Function called on every loop to move the game forward, it never blocks
+    void update() {
+      switch (phase) {
+        case (PHASE_INTRO): //after "Hello!" has been displayed for a second
+          if (phaseElapsed()) {
+            setColor(0, 0, 0); //turn off green color
+            lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+            lcd.print(F("Difficulty ")); //print to the LCD screen
+            lcd.setCursor(15, 0); //set cursor to the last position from the top
+            lcd.write('A' + profile); //player profile, changed with A, B or C
+            showLevels(); //"1-E 2-M 3-H 4-X" from the level table
+            setPhase(PHASE_LEVEL_SELECT, 0); //wait for a level to be chosen
+          }
+          break;
+        case (PHASE_LEVEL_DELAY): //wait for a second before starting
+          if (phaseElapsed()) {
+            lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+            playGame(); //play the game
+          }
+          break;
+        case (PHASE_STIMULUS): //blink or buzz the numbers once the message has been displayed and no other station uses them
+          if (phaseElapsed() && pulses.idle()) {
+            lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+            pulses.play(stimulus, stimulusDone, this); //the timer interrupt plays the pulses
+            setPhase(PHASE_STIMULUS, 0); //wait for the end of the playback
+          }
+          break;
+        case (PHASE_ANSWERING): //update the timer
+          updateTimer(); //check the timer and redraw it if needed
+          break;
+        case (PHASE_FEEDBACK): //after the answer has been checked
+          if (phaseElapsed()) {
+            finishQuestion(); //go to the next question or show the score
+          }
+          break;
+        case (PHASE_SCORE): //after the game score has been displayed
+          if (phaseElapsed()) {
+            showTotalScore(); //display the total score
+          }
+          break;
+        case (PHASE_GOODBYE): //after "Good Bye!" has been displayed
+          if (phaseElapsed()) {
+            setColor(0, 0, 0); //turn off red color
+            lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+            clearGame(); //reset values
+          }
+          break;
+      }
+    }
+
+    // Function used to print the keys and letters of the levels on the second row of the difficulty menu
+    void showLevels() {
+      lcd.setCursor((16 - (LEVEL_COUNT * 4 - 1)) / 2, 1); //centered
+      for (byte i = 0; i < LEVEL_COUNT; i++) {
+        if (i != 0) {
+          lcd.write(' ');
+        }
+        lcd.write('1' + i); //key of the level
+        lcd.write('-');
+        lcd.write(pgm_read_byte(&LEVEL_TABLE.levels[i].letter));
+      }
+    }
+
+    // Function called from loop() when the blinks/buzzes have been played
+    static void stimulusDone(void *game) {
+      ((SpeedMath *)game)->showOperation();
     }
 
-    // Function used to generate random questions for the medium level game
-    void generateMed(void) {
-      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-      generateNumbers(1, 10, 1, 10, 1, 10, 1, 10); //the range is [1, 10]
-      lcd.print("Look carefully!"); //print to the LCD screen for 2 seconds
-      delay(2000);
-      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-      for (int i = 1; i <= num1; i++) { //used for blinking num1
-        analogWrite(bluePin, 255); //writes an analog value (PWM wave) to blue pin for 250 ms
-        delay(250);
-        analogWrite(bluePin, 0); //turn it off for 250 ms
-        delay(250);
-      }
-      delay(1000); //wait for a second before blinking num2
-      for (int i = 1; i <= num2; i++) { //used for blinking num2
-        analogWrite(bluePin, 255); //writes an analog value (PWM wave) to blue pin for 250 ms
-        delay(250);
-        analogWrite(bluePin, 0); //turn it off for 250 ms
-        delay(250);
-      }
-      delay(1000); //wait for a second before displaying the operation
-      lcd.createChar(0, blankChar); //create a custom character for displaying the question
+    // Function used to display the operation of a medium/hard question with blanks for the numbers
+    void showOperation() {
+      if (phase != PHASE_STIMULUS) { //the game has been stopped
+        return;
+      }
+      lcd.createChar(GLYPH_BLANK, blankChar); //create a custom character for displaying the question
       lcd.home(); //positions the cursor in the upper-left of the LCD
-      lcd.write(0); //write the custom character to the LCD
-      lcd.print(operation); //print the operation to the LCD
-      lcd.write(0); //write the custom character to the LCD again
-      lcd.print("="); //print the operation to the LCD
-      numChar = 4; //number of characters on the LCD
-      delayStart = millis(); //start delay
-      delayRunning = true; //delay not finished yet
+      lcd.write(GLYPH_BLANK); //write the custom character to the LCD
+      lcd.write(operation); //print the operation to the LCD
+      lcd.write(GLYPH_BLANK); //write the custom character to the LCD again
+      lcd.write('='); //print the equal sign to the LCD
+      startAnswering(); //start the timer
     }
 
-    // Function used to generate random questions for the hard level game
-    void generateHard(void) {
-      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-      generateNumbers(1, 10, 1, 10, 1, 10, 1, 10); //the range is [1, 10]
-      lcd.print("Listen carefully!"); //print to the LCD for 2 seconds
-      delay(2000);
-      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-      for (int i = 1; i <= num1; i++) { //used for "buzzing" num1
-        tone(speaker, 1000); //start speaker sound for 250ms
-        delay(250);
-        noTone(speaker); //Stop buzzing
-      }
-      delay(1000); //wait for a second before "buzzing" num2
-      for (int i = 1; i <= num2; i++) { //used for "buzzing" num1
-        tone(speaker, 1000); //start speaker sound for 250ms
-        delay(250);
-        noTone(speaker); //Stop buzzing
-      }
-      delay(1000); //wait for a second before displaying the operation
-      lcd.createChar(0, blankChar); //create a custom character for displaying the question
-      lcd.home(); //positions the cursor in the upper-left of the LCD
-      lcd.write(0); //write the custom character to the LCD
-      lcd.print(operation); //print the operation to the LCD
-      lcd.write(0); //write the custom character to the LCD again
-      lcd.print("="); //print the operation to the LCD
-      numChar = 4; //number of characters on the LCD
-      delayStart = millis(); //start delay
-      delayRunning = true; //delay not finished yet
+    // Function used to start the timer once the question is displayed
+    void startAnswering() {
+      timer.start(level.timerSeconds); //start the timer of the level
+      setPhase(PHASE_ANSWERING, 0); //the timer decides when the question ends
+      events.question(station, difficulty - '1', op - 1, num1, num2, correctValue);
     }
 
     // Function used to reset values after each question
     void clean() {
       num1 = num2 = correctValue = 0;
-      input = "";
+      inputLength = 0;
       numChar = 0;
     }
 
-    // Function used to count the number of digits in a number
-    int countDigit(int n) {
-      int count = 0;
-      while (n != 0) {
-        n = n / 10;
-        ++count;
+    // Function used to print a number to the LCD without the String class, returns the number of characters
+    byte printNumber(int value) {
+      char text[12]; //enough for any int
+      byte length = formatNumber(text, value);
+      lcd.print(text);
+      return length;
+    }
+
+    // Function used to pick a random divisor of n (n in [1, 99]) that is not smaller than minDiv
+    int pickDivisor(int n, byte minDiv) {
+      unsigned int first = pgm_read_word(&DIVISORS.start[n]); //first divisor of n in the table
+      unsigned int last = pgm_read_word(&DIVISORS.start[n + 1]); //end of the divisors of n
+      while (pgm_read_byte(&DIVISORS.list[first]) < minDiv) { //skip divisors below the range, n itself always stays
+        first++;
       }
-      return count;
+      return pgm_read_byte(&DIVISORS.list[first + rng.below(last - first)]); //every valid divisor is equally likely
     }
 
-    // Function used to generate the numbers for the game in the range [1, 255]
+    // Function used to generate the numbers for the game in the range [1, 99]
     void generateNumbers(byte minAdd, byte maxAdd, byte minSub, byte maxSub, byte minMul, byte maxMul, byte minDiv, byte maxDiv) {
-      op = random(1, 5); //generate a random number [1,4] for the type of operation
+      op = rng.between(1, 5); //generate a random number [1,4] for the type of operation
       // Switch statement used for performing mathematical calculation
       switch (op) {
         case (1): //if the random number is "1", perform addition
-          operation = "+"; //type of operation is addition
-          num1 = random(minAdd, maxAdd); //generate a random number [1-99] for the first operand
-          num2 = random(minAdd, maxAdd); //generate a random number [1-99] for the second operand
+          operation = '+'; //type of operation is addition
+          num1 = rng.between(minAdd, maxAdd); //generate a random number [1-99] for the first operand
+          num2 = rng.between(minAdd, maxAdd); //generate a random number [1-99] for the second operand
           correctValue = num1 + num2; //perform addition
           break;
         case (2): //if the random number is "2", perform subtraction
-          operation = "-"; //type of operation is subtraction
-          num1 = random(minSub, maxSub); //generate a random number [1-99] for the first operand
-          num2 = random(minSub, maxSub); //generate a random number [1-99] for the second operand
-          while (num1 < num2) { //calculation results cannot be negative
-            num2 = random(minSub, maxSub);
-          }
+          operation = '-'; //type of operation is subtraction
+          num1 = rng.between(minSub, maxSub); //generate a random number [1-99] for the first operand
+          num2 = rng.between(minSub, num1 + 1); //generate a random number [1-num1] so the result cannot be negative
           correctValue = num1 - num2; //perform subtraction
           break;
         case (3): //if the random number is "3", perform multiplication
-          operation = "x"; //type of operation is multiplication
-          num1 = random(minMul, maxMul); //generate a random number [1-19] for the first operand
-          num2 = random(minMul, maxMul); //generate a random number [1-19] for the second operand
+          operation = 'x'; //type of operation is multiplication
+          num1 = rng.between(minMul, maxMul); //generate a random number [1-19] for the first operand
+          num2 = rng.between(minMul, maxMul); //generate a random number [1-19] for the second operand
           correctValue = num1 * num2; //perform multiplication
           break;
         case (4): //if the random number is "4", perform division
-          operation = "/"; //type of operation is division
-          num1 = random(minDiv, maxDiv); //generate a random number [1-99] for the first operand
-          num2 = random(minDiv, maxDiv); //generate a random number [1-99] for the second operand
-          while ((num1 < num2) || ((num1 % num2) != 0)) { //calculation results cannot be decimal
-            num2 = random(minDiv, maxDiv);
-          }
+          operation = '/'; //type of operation is division
+          num1 = rng.between(minDiv, maxDiv); //generate a random number [1-99] for the first operand
+          num2 = pickDivisor(num1, minDiv); //pick one of its divisors so the result cannot be decimal
           correctValue = num1 / num2; //perform division
           break;
       }
     }
 
+    // Function used to pack the numbers just generated into a question, printed questions take their real width on the LCD
+    Question makeQuestion(bool printed) {
+      Question question;
+      question.num1 = num1;
+      question.num2 = num2;
+      question.answer = correctValue;
+      question.op = op - 1;
+      question.width = printed ? (digitCount(num1) + digitCount(num2) + 2) : 4; //the numbers are blanks when pulsed
+      return question;
+    }
+
+    // Function used to load the next question of the deck
+    void nextQuestion() {
+      const Question &question = deck.draw();
+      num1 = question.num1;
+      num2 = question.num2;
+      correctValue = question.answer;
+      op = question.op + 1;
+      operation = pgm_read_byte(&OPERATIONS[question.op]);
+      numChar = question.width; //number of characters used by the question on the LCD
+    }
+
+    // Function used to count the digits of a positive number below 1000
+    static constexpr byte digitCount(int value) {
+      return (value >= 100) ? 3 : ((value >= 10) ? 2 : 1);
+    }
+
     // Function used for initializing the game
     void initGame() {
       lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
       int potValue = analogRead(potentiometerPin) / 4; //measure the potentiometer value (max 255)
       setColor(0, potValue, 0); //light up the RGB LED with green color
-      lcd.print("Hello!"); //print to the LCD screen
-      tone(speaker, 3000, 1000); //start speaker sound for 1 second
-      delay(1000);
-      setColor(0, 0, 0); //turn off green color
-      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-      lcd.print("Difficulty "); //print to the LCD screen
-      lcd.setCursor(2, 1); //sLevelet cursor to the third position from the bottom
-      lcd.print("1-E 2-M 3-H"); //print to the LCD screen
+      lcd.print(F("Hello!")); //print to the LCD screen
+      startTone(3000, 1000); //start speaker sound for 1 second
+      setPhase(PHASE_INTRO, 1000); //the difficulty menu is displayed after a second
     }
 
     // Function used for setting up the game
     void setUpGame() {
       lcd.backlight(); //turn on blacklight
       setUp = true; //the game has been set up
-      isExited = false; //the game has not been exited
       initGame(); //initialize the game
-      char key;
-      do { //keep looping until a level is chosen and the user has not chosen to exit the game
-        key = keypad.getKey(); //value of a key being pressed
-        if ((key == '1') || (key == '2') || (key == '3')) { //if a level is chosen
-          delay(1000); //wait for a second before starting
-          lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-          levelChosen = true; //level has been chosen
-          difficulty = key; //sets difficulty level
-          playMode = true; //user is now in play mode
-          playGame(); //play the game
-        }
-        else if (key == '*') { //if user has chosen to stop the game
-          stopGame(); //stop the game
-        }
-      } while (((key != '1') && (key != '2') && (key != '3') && (levelChosen != true)) && (!isExited));
+    }
+
+    // Function used when a level is chosen from the difficulty menu
+    void chooseLevel(char key) {
+      difficulty = key; //sets difficulty level
+      memcpy_P(&level, &LEVEL_TABLE.levels[key - '1'], sizeof(level)); //code of the level, no switch on the level later
+      numQuestions = level.questions; //number of questions of the level
+      if (headToHead) { //the same deck as the other stations on their game of the same rank on this level, a new one on a replay
+        rng.seed(matchSeed + key + ((uint32_t)matchPlays[key - '1']++ << 8));
+      }
+      playMode = true; //user is now in play mode
+      level.buildDeck(*this); //all the questions are drawn now, while the player waits
+      setPhase(PHASE_LEVEL_DELAY, 1000); //wait for a second before starting
     }
 
     // Function for playing the game based on difficulty level
     void playGame() {
       numQuestions -= 1; //decrement number of questions
-      // Switch statement used for generating questions based on difficulty level
-      switch (difficulty) {
-        case ('1'): //if difficulty is easy
-          generateEasy(); //generate random easy questions
-          break;
-        case ('2'): //if difficulty is medium
-          generateMed(); //generate random medium questions
-          break;
-        case ('3'): //if difficulty is hard
-          generateHard(); //generate random hard questions
-          break;
-      }
+      questionI2cStart = lcd.i2cBytes; //start counting the I2C bytes of this question
+      level.present(*this); //show the question the way of the level
     }
 
     // Function used to check if the inputted values match the correct values
     void checkAnswer() {
+      PROFILE_SCOPE(PROBE_CHECK_ANSWER);
       lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
       int potValue = analogRead(potentiometerPin) / 4; //measure the potentiometer value (max 255)
-      if (input.toInt() == correctValue) { //if they match
+      bool correct = (parseNumber(input, inputLength) == correctValue); //if they match, nothing typed reads as 0
+      unsigned long taken = timer.elapsed(); //time taken to answer
+      unsigned int typed = (inputLength != 0) ? parseNumber(input, inputLength) : 0xFFFF; //0xFFFF if nothing was typed
+      events.answer(station, profile, op - 1, correct, taken >= timer.durationMs, typed, (taken < 0xFFFF) ? taken : 0xFFFF);
+      if (correct) { //if they match
         score += 1; //increment the score value
-        tone(speaker, 4500, 800); //start speaker sound for 1 second
-        lcd.createChar(0, smileyFace); //create a custom character (smiley face)
+        startTone(4500, 800); //start speaker sound for 1 second
+        lcd.createChar(GLYPH_SMILEY, smileyFace); //create a custom character (smiley face)
         lcd.home(); //positions the cursor in the upper-left of the LCD
-        lcd.print("Correct!"); //print to the LCD screen
-        lcd.write(0); //write the custom character to the LCD
+        lcd.print(F("Correct!")); //print to the LCD screen
+        lcd.write(GLYPH_SMILEY); //write the custom character to the LCD
         setColor(0, potValue, 0); //light up the RGB LED with green color
       } else { //if they do not match
-        tone(speaker, 500, 800); //start speaker sound for 1 second
-        lcd.createChar(0, sadFace); //create a custom character (sad face)
+        startTone(500, 800); //start speaker sound for 1 second
+        lcd.createChar(GLYPH_SAD, sadFace); //create a custom character (sad face)
         lcd.home(); //positions the cursor in the upper-left of the LCD
-        lcd.print("Incorrect!"); //print to the LCD screen
-        lcd.write(0); //write the custom character to the LCD
+        lcd.print(F("Incorrect!")); //print to the LCD screen
+        lcd.write(GLYPH_SAD); //write the custom character to the LCD
         setColor(potValue, 0, 0); //light up the RGB LED with red color
       }
-      delay(1000); //wait for 1 second
+      setPhase(PHASE_FEEDBACK, 1000); //keep the result for 1 second
+    }
+
+    // Function used once the result of a question has been displayed
+    void finishQuestion() {
+      profiler.recordQuestion(lcd.i2cBytes - questionI2cStart); //I2C bytes sent for this question
       setColor(0, 0, 0); //turn off RGB LED color
       lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
       clean(); //reset values
+      if (numQuestions > 0) { //if there are questions left
+        playGame(); //keep playing the game
+      } else { //if no questions left
+        endGame(); //save the score before it is displayed
+        lcd.setCursor(5, 0); //set cursor to the sixth position from the top
+        lcd.print(F("Score:")); //print to the LCD screen
+        printNumber(score);
+        lcd.write('/');
+        printNumber(level.questions);
+        setPhase(PHASE_SCORE, 1500); //keep the score for 1.5 seconds
+      }
+    }
+
+    // Function used once the last question has been answered, the score is saved at once so stopping the game from the last result
+    // or from the score screen keeps it
+    void endGame() {
+      playMode = false; //user has finished the game
+      events.gameEnd(station, profile, difficulty - '1', score, level.questions);
+      scores.add(profile, score); //update total score, it is written to the EEPROM in the background
+    }
+
+    // Function used to display the total score saved in the EEPROM
+    void showTotalScore() {
+      lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+      lcd.print(F("Total Score ")); //print to the LCD screen
+      lcd.write('A' + profile); //player profile
+      lcd.setCursor(0, 1); //set cursor to the first position from the bottom
+      printNumber(scores.total(profile)); //print total score on the LCD
+      setPhase(PHASE_TOTAL, 0); //wait until the game is stopped
     }
 
-    //Function to check if there are questions left
+    //Function to check the answer when the user is done or the timer ends
     void continueGame() {
-      if (numQuestions > 0) { //if there are questions left
-        checkAnswer(); //check the answer
-        playGame(); //keep playing the game
-      } else if (numQuestions == 0 && playMode == true) { //if no questions left
+      if (phase == PHASE_ANSWERING) { //only while a question is open
+        timer.stop(); //stop the timer
         checkAnswer(); //check the answer
-        playMode = false; //user has finished the game
-        lcd.setCursor(5, 0); //set cursor to the sixth position from the top
-        lcd.print("Score:" + String(score) + "/10"); //print to the LCD screen
-        delay(1500); //wait for 1.5 seconds
-        lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-        lcd.print("Total Score"); //print to the LCD screen
-        lcd.setCursor(0, 1); //set cursor to the first position from the bottom
-        totScore = EEPROM.get(addTotScore, totScore) + score; //update total score
-        EEPROM.put(addTotScore, totScore); //write total score to the EEPROM
-        lcd.print(String(EEPROM.get(addTotScore, totScore))); //print total score on the LCD from EEPROM
       }
     }
 
     // Function for stopping the game
     void stopGame() {
-      if (!isExited) { //stop the game if it has not been already stopped
+      if ((phase != PHASE_IDLE) && (phase != PHASE_GOODBYE)) { //stop the game if it has not been already stopped
+        if ((phase == PHASE_FEEDBACK) && (numQuestions == 0)) { //the last answer is displayed, the game is over
+          endGame(); //keep its score
+        }
         clean(); //reset values
+        pulses.release(this); //stop the blinking or buzzing of this game
+        playMode = false; //user is no longer in play mode
+        timer.stop(); //stop the timer
         lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
         setColor(255, 0, 0); //light up the RGB LED with red color
         lcd.setCursor(6, 0); //set cursor to the seventh position from the top
-        lcd.print("Good"); //print to the LCD screen
+        lcd.print(F("Good")); //print to the LCD screen
         lcd.setCursor(6, 1); //set cursor to the seventh position from the bottom
-        lcd.print("Bye!"); //print to the LCD screen
-        delay(2000); //clear everything after 2 seconds
-        setColor(0, 0, 0); //turn off red color
-        lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
-        clearGame(); //reset values
+        lcd.print(F("Bye!")); //print to the LCD screen
+        setPhase(PHASE_GOODBYE, 2000); //clear everything after 2 seconds
       }
     }
 
     // Function for resetting values after every game
     void clearGame() {
       lcd.noBacklight(); //turn off backlight
-      isExited = true; //the game has been stopped
       setUp = false; //the game can be set up when it is on again
-      numQuestions = 10; //the number of questions is back to 10
-      difficulty = NULL; //difficulty can be chosen again later
-      levelChosen = false; //level can be chosen again later
+      numQuestions = 0; //set again when a level is chosen
+      difficulty = '\0'; //difficulty can be chosen again later
       score = 0; //reset the score
+      setPhase(PHASE_IDLE, 0); //wait for the IR sensor again
+    }
+
+    // Function used to bring an idle game back to its state after setup(), before a session is replayed on it
+    void restart(uint32_t seed) {
+      rng.seed(seed);
+      profile = 0;
+      startMatch();
+    }
+
+    // Function used when a head-to-head match starts, every level is new again
+    void startMatch() {
+      memset(matchPlays, 0, sizeof(matchPlays));
+    }
+
+    // Function used when A, B or C is pressed to choose the player profile on the difficulty menu
+    void chooseProfile(char key) {
+      if (phase == PHASE_LEVEL_SELECT) {
+        profile = key - 'A'; //0, 1 or 2
+        lcd.setCursor(15, 0); //set cursor to the last position from the top
+        lcd.write(key); //show the new profile
+      }
     }
 
     // Function used when a number is pressed on the Keypad
     void numPress(char num) {
-      if (playMode) { //if the user is in play mode
+      if (phase == PHASE_LEVEL_SELECT) { //if the difficulty menu is displayed
+        if ((num >= '1') && (num < '1' + LEVEL_COUNT)) { //if a level is chosen
+          chooseLevel(num); //start the chosen level
+        }
+      } else if ((phase == PHASE_ANSWERING) && (inputLength < MAX_INPUT)) { //if the user is answering a question
         lcd.setCursor(numChar, 0); //set the cursor to the position after the printed characters
-        input += num; //convert the numbers to a string of numbers
+        input[inputLength++] = num; //add the digit to the typed number
         numChar += 1; //increment the number of characters displayed on the LCD
         lcd.write(num); //write the number to the LCD
-        tone(speaker, 1000, 300); //start speaker sound for 1 second
+        startTone(1000, 300); //start speaker sound for 1 second
       }
     }
 
     // Function used to delete a character typed during the game
     void deleteChar() {
-      if (input.length() != 0) { //if there are characters typed by the user
+      if ((phase == PHASE_ANSWERING) && (inputLength != 0)) { //if there are characters typed by the user
         numChar -= 1; //decrement the number of characters displayed on the LCD
-        input.remove(input.length() - 1); //remove the last character from the input string
+        inputLength -= 1; //remove the last digit from the typed number
         lcd.setCursor(numChar, 0); //set the cursor to the last position
-        lcd.print(" "); //hide the character from the LCD
+        lcd.write(' '); //hide the character from the LCD
         lcd.setCursor(numChar, 0); //set the cursor to the last position
       }
     }
 
-    // Use PWM to control the brightness of the RGB LED [0-255]
-    void setColor(int redValue, int greenValue, int blueValue) {
-      analogWrite(redPin, redValue); //writes an analog value (PWM wave) to red pin
-      analogWrite(greenPin, greenValue); //writes an analog value (PWM wave) to green pin
-      analogWrite(bluePin, blueValue); //writes an analog value (PWM wave) to blue pin
+    // Function used to set the RGB LED [0-255] the way analogWrite() did: green is dimmed by the Timer2 PWM, red (PB4) has no timer
+    // output so it is on from 128, and blue (OC1B) is only on at 255 since Timer1 runs in normal mode for the profiler
+    void setColor(byte redValue, byte greenValue, byte blueValue) {
+      RedPin::write(redValue >= 128);
+      GreenPwm::write(greenValue); //one store to OCR2A
+      BluePin::write(blueValue == 255);
     }
 
-    //Function used to set up the timer based on difficulty level
-    void setUpTimer() {
-      // Switch statement used for setting the timer based on difficulty level
-      switch (difficulty) {
-        case ('1'): //if difficulty is easy
-          setTimer(20); //sets a timer of 20 seconds
-          break;
-        case ('2'): //if difficulty is medium
-          setTimer(15); //sets a timer of 10 seconds
-          break;
-        case ('3'): //if difficulty is hard
-          setTimer(10); //sets a timer of 10 seconds
-          break;
-      }
-    }
-
-    //Function used to create the timer
-    void setTimer(unsigned long inSeconds) {
-      if (playMode) { //if the game is in play mode
-        if (inSeconds < 86400) { //maximum is 23h:59m:59s = 86399 seconds
-          bool secondPrinted = false; //can only be printed once
-          // Check if delay has timed out after 5 seconds
-          if (delayRunning && ((millis() - delayStart) >= (inSeconds * 1000))) {
-            delayRunning = false; //this code can only run once
-            continueGame(); //continue playing the game
-          }
-          else { //if the timer has not timed out
-            for (int i = 1; i <= inSeconds; i++) { //check if another second has passed
-              if ((delayRunning && ((millis() - delayStart) >= ((inSeconds - i) * 1000))) && !secondPrinted) {
-                secondPrinted = true; //only check for the first correct condition
-                displayTimer(i); //display the timer on the LCD
-              }
-            }
-          }
-        }
+    //Function used to end the question when the timer runs out and redraw it when a second passes
+    void updateTimer() {
+      if (timer.expired()) { //the time is up
+        continueGame(); //continue playing the game
+      } else if (timer.changed()) { //another second has passed
+        displayTimer(timer.shown); //display the timer on the LCD
       }
     }
 
     //Function used to display the timer on the LCD
     void displayTimer(int totalSecond) {
+      PROFILE_SCOPE(PROBE_DISPLAY_TIMER);
       lcd.setCursor(0, 1); //set the cursor to the first position from the bottom
-      char timeFormat[8]; //for formatting the time
-
-      //Return a formatted string in the form HH:MM:SS
-      sprintf(timeFormat, "%02d:%02d:%02d", totalSecond / 3600, (totalSecond % 3600) / 60, totalSecond % 60);
+      char timeFormat[9]; //for formatting the time (8 characters and the terminator)
+      formatTime(timeFormat, totalSecond); //in the form HH:MM:SS, without sprintf
       lcd.print(timeFormat); //print it to the LCD
     }
 };
+
+// Outputs and message of a channel that pulses the operands: num1 on FIRST, num2 on SECOND, the SQUARE bits buzz at 1 kHz
+template <Channel C> struct ChannelTraits;
+
+template <> struct ChannelTraits<CHANNEL_LED> {
+  static const byte FIRST = BluePin::MASK;
+  static const byte SECOND = BluePin::MASK;
+  static const byte SQUARE = 0; //the LED is held on
+  static const __FlashStringHelper *message() { return F("Look carefully!"); }
+};
+
+template <> struct ChannelTraits<CHANNEL_SPEAKER> {
+  static const byte FIRST = SpeakerPin::MASK;
+  static const byte SECOND = SpeakerPin::MASK;
+  static const byte SQUARE = SpeakerPin::MASK; //1 kHz tone
+  static const __FlashStringHelper *message() { return F("Listen carefully!"); }
+};
+
+template <> struct ChannelTraits<CHANNEL_LED_SPEAKER> {
+  static const byte FIRST = BluePin::MASK;
+  static const byte SECOND = SpeakerPin::MASK;
+  static const byte SQUARE = SpeakerPin::MASK; //1 kHz tone
+  static const __FlashStringHelper *message() { return F("Look and listen!"); }
+};
+
+// Shows a question of level L whose operands are pulsed: the message for 2 seconds, then the pulses from the timer interrupt
+template <Channel C, byte L> struct Presenter {
+  static void present(SpeedMath &game) {
+    PROFILE_SCOPE(PROBE_PRESENT_LCD + C);
+    game.lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+    game.nextQuestion(); //take the next question of the deck
+    game.lcd.print(ChannelTraits<C>::message()); //print to the LCD for 2 seconds
+    game.stimulus = PulseScript(ChannelTraits<C>::SQUARE, LEVELS[L].pulseMs, LEVELS[L].silenceMs);
+    game.stimulus.add(ChannelTraits<C>::FIRST, game.num1, 1000); //num1 pulses, 1 second
+    game.stimulus.add(ChannelTraits<C>::SECOND, game.num2, 1000); //num2 pulses, 1 second before the operation
+    game.setPhase(SpeedMath::PHASE_STIMULUS, 2000); //keep the message for 2 seconds
+  }
+};
+
+// Shows a question of level L printed on the LCD
+template <byte L> struct Presenter<CHANNEL_LCD, L> {
+  static void present(SpeedMath &game) {
+    PROFILE_SCOPE(PROBE_PRESENT_LCD);
+    game.lcd.clear(); //clear LCD screen and position the cursor in the upper-left corner
+    game.nextQuestion(); //take the next question of the deck
+    game.printNumber(game.num1); //print the question to the LCD
+    game.lcd.write(game.operation);
+    game.printNumber(game.num2);
+    game.lcd.write('=');
+    game.startAnswering(); //start the timer
+  }
+};
+
+// Function used to get the largest answer of an operation (0 '+', 1 '-', 2 'x', 3 '/') over its operand range
+constexpr int largestAnswer(OperandRange range, byte op) {
+  return (op == 0) ? 2 * (range.high - 1) :
+         ((op == 1) ? (range.high - 1 - range.low) : ((op == 2) ? (range.high - 1) * (range.high - 1) : (range.high - 1) / range.low));
+}
+
+// Function used to check that an operand range is not empty and does not hold 0 (the ranges are bytes, so operands stay below 256)
+constexpr bool rangeValid(OperandRange range) {
+  return (range.low >= 1) && (range.low < range.high);
+}
+
+// Function used to check that the answers of an operation fit the 9-bit field of a question
+constexpr bool answerFits(OperandRange range, byte op) {
+  return largestAnswer(range, op) <= Question::MAX_ANSWER;
+}
+
+// Function used to check that the widest question of an operation and its typed answer fit on the first row of the LCD
+constexpr bool questionFits(OperandRange range, byte op) {
+  return (SpeedMath::digitCount(largestAnswer(range, op)) <= MAX_INPUT) &&
+         (2 * SpeedMath::digitCount(range.high - 1) + 2 + MAX_INPUT <= LcdBuffer::LCD_COLS);
+}
+
+// Code of level L, every setting of LEVELS[L] is a constant in it
+template <byte L> struct LevelCode {
+  static_assert(LEVELS[L].questions <= QuestionDeck::SIZE, "the deck has no room for the questions of the level");
+  static_assert(rangeValid(LEVELS[L].ranges[0]) && rangeValid(LEVELS[L].ranges[1]) && rangeValid(LEVELS[L].ranges[2]) &&
+                rangeValid(LEVELS[L].ranges[3]), "an operand range of the level is empty or holds 0");
+  static_assert(LEVELS[L].ranges[3].high <= DIVIDEND_MAX + 1, "the dividends of the level go past the divisor table");
+  static_assert(answerFits(LEVELS[L].ranges[0], 0) && answerFits(LEVELS[L].ranges[1], 1) && answerFits(LEVELS[L].ranges[2], 2) &&
+                answerFits(LEVELS[L].ranges[3], 3), "an answer of the level does not fit in a question");
+  static_assert(questionFits(LEVELS[L].ranges[0], 0) && questionFits(LEVELS[L].ranges[1], 1) &&
+                questionFits(LEVELS[L].ranges[2], 2) && questionFits(LEVELS[L].ranges[3], 3),
+                "a question of the level and its answer do not fit on the LCD");
+  static_assert((LEVELS[L].timerSeconds >= 1) && (LEVELS[L].questions >= 1), "the level has no time or no questions");
+
+  // Function used to draw the numbers of a question in the ranges of the level
+  static void generateNumbers(SpeedMath &game) {
+    game.generateNumbers(LEVELS[L].ranges[0].low, LEVELS[L].ranges[0].high, LEVELS[L].ranges[1].low, LEVELS[L].ranges[1].high,
+                         LEVELS[L].ranges[2].low, LEVELS[L].ranges[2].high, LEVELS[L].ranges[3].low, LEVELS[L].ranges[3].high);
+  }
+
+  // Function used to draw the questions of a whole game into the deck, a question already in the deck is drawn again
+  static void buildDeck(SpeedMath &game) {
+    game.deck.clear();
+    for (byte i = 0; i < LEVELS[L].questions; i++) {
+      Question question;
+      byte tries = 0;
+      do {
+        generateNumbers(game); //operands in the ranges of the level
+        question = game.makeQuestion(LEVELS[L].channel == CHANNEL_LCD);
+        tries += 1;
+      } while (game.deck.contains(question) && (tries < QuestionDeck::RETRIES));
+      if (game.deck.contains(question)) { //the retries ran out
+        game.deck.duplicates += 1;
+      }
+      game.deck.add(question);
+    }
+  }
+
+  // Function used to get the entry of the level in LEVEL_TABLE
+  static constexpr LevelOps ops() {
+    return {buildDeck, Presenter<LEVELS[L].channel, L>::present, generateNumbers, LEVELS[L].timerSeconds, LEVELS[L].questions,
+            LEVELS[L].letter};
+  }
+};
+
+// Indices 0 to N - 1, used to expand a table with one entry per level or per station
+template <byte... I> struct Indices {};
+template <byte N, byte... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <byte... I> struct MakeIndices<0, I...> {
+  typedef Indices<I...> type;
+};
+
+// Function used to make the table of the levels at compile time
+template <byte... I> constexpr LevelTable makeLevelTable(Indices<I...>) {
+  return {{LevelCode<I>::ops()...}};
+}
+
+const LevelTable LEVEL_TABLE PROGMEM = makeLevelTable(MakeIndices<LEVEL_COUNT>::type());
+}
+
+// One player station: an LCD at its own I2C address, a keypad and the game played on them
+class Station
+{
+  public:
+    LiquidCrystal_I2C device; //LCD library object
+    LcdBuffer lcd; //all drawing of the station goes through the buffer
+    Game::ExpanderKeypad pad; //keypad of the station, except on the first station whose keypad is on the board pins
+    Game::KeyQueue queue; //key presses waiting for the slice of the station
+    Game::SpeedMath game; //game played on the station
+    unsigned long worstKeyLatencyMicros = 0; //longest time between a key press and its handling
+    unsigned long keysHandled = 0; //number of key presses handled
+
+    Station(byte index)
+      : device(LCD_ADDRESS - index, 16, 2), lcd(device, LCD_ADDRESS - index), pad(KEYPAD_EXPANDER_ADDRESS + index - 1),
+        game(lcd, index) {}
+};
+
+// Every station the board can serve, built in place from their index
+template <typename Sequence> struct StationArray;
+template <byte... I> struct StationArray<Game::Indices<I...>> {
+  Station at[sizeof...(I)];
+  StationArray() : at{{I}...} {}
+};
+StationArray<Game::MakeIndices<STATIONS>::type> stations;
+
+// Number of stations wired to the board, found by setup()
+byte stationCount = 1;
+
+// Station served by the next loop() iteration, the stations take turns
+byte nextStation = 0;
+
+// LCD cells sent by a loop() iteration, about 6 ms at 100 kHz: a full screen would hold the bus and the other stations for 15 ms
+const byte CELLS_PER_SLICE = 8;
+
+// Game of the first station, whose keypad is scanned by the timer interrupt
+Game::SpeedMath &my_game = stations.at[0].game;
+
+// Key presses of the first station waiting to be handled by loop()
+Game::KeyQueue &keyQueue = stations.at[0].queue;
+
+// Longest time between a key press and its handling by loop() on any station, in microseconds
+unsigned long worstKeyLatencyMicros = 0;
+
+// Number of key presses handled by loop() on every station
+unsigned long keysHandled = 0;
+
+// Function called from the timer interrupt to scan the keypad, the library only scans once every 10 ms to debounce the keys
+void scanKeypad() {
+  PROFILE_SCOPE(Game::PROBE_KEYPAD_SCAN);
+  if (keypad.getKeys()) { //a key changed state
+    for (byte i = 0; i < LIST_MAX; i++) { //every key pressed since the last scan, even if another one is still held
+      if (keypad.key[i].stateChanged && (keypad.key[i].kstate == PRESSED)) {
+        keyQueue.push(keypad.key[i].kchar, micros()); //time stamp the key press
+      }
+    }
+  }
+}
+
+#ifndef SPEEDMATH_HOST
+// Timer0 compare B interrupt, fires once per millisecond next to the overflow interrupt used by millis()
+ISR(TIMER0_COMPB_vect) {
+  scanKeypad();
+}
+#endif
+
+// Function called from the Timer1 interrupt every 0.5 ms while blinks/buzzes are played
+#ifdef SPEEDMATH_HOST
+unsigned long pulseTick(unsigned long count) { //the virtual clock hands over the ticks until the next change at once
+  return Game::pulses.ticks(count);
+}
+#else
+void pulseTick() {
+  Game::pulses.tick();
+}
+#endif
+
+#ifndef SPEEDMATH_HOST
+// Timer1 compare A interrupt, only enabled while the pulse sequencer plays
+ISR(TIMER1_COMPA_vect) {
+  OCR1A += 1000; //next tick 0.5 ms after this one, whatever the interrupt latency
+  pulseTick();
 }
+#endif
 
-// Initializing an object of class SpeedMath
-Game::SpeedMath my_game;
+// Function used to run Timer1 freely at 2 MHz, the profiler reads it and the pulse sequencer schedules its interrupt on it
+void startTimer1() {
+#ifndef SPEEDMATH_HOST
+  TCCR1A = 0; //normal mode, no PWM on pins 9 and 10: the blue LED is only switched fully on or off
+  TCCR1B = _BV(CS11); //16 MHz / 8 = 2 MHz, the 16-bit counter wraps every 32.768 ms
+  TIMSK1 = _BV(TOIE1); //count the wraps for 32-bit time stamps
+#endif
+}
+
+// Function used to start the pulse sequencer interrupt, the first tick comes exactly 0.5 ms later
+void startPulseTimer() {
+#ifdef SPEEDMATH_HOST
+  simTimer1Hook = pulseTick; //called with the 0.5 ms ticks of virtual time
+#else
+  OCR1A = TCNT1 + 1000; //1000 ticks of 0.5 us from now
+  TIFR1 = _BV(OCF1A); //drop a compare match left from before
+  TIMSK1 |= _BV(OCIE1A); //enable the compare A interrupt
+#endif
+}
+
+// Function used to stop the pulse sequencer interrupt
+void stopPulseTimer() {
+#ifdef SPEEDMATH_HOST
+  simTimer1Hook = 0;
+#else
+  TIMSK1 &= ~_BV(OCIE1A); //disable the compare A interrupt
+#endif
+}
+
+#ifndef SPEEDMATH_HOST
+volatile unsigned int toneToggles = 0; //speaker toggles left, the tone stops at 0
+unsigned int toneHalfPeriod = 0; //Timer1 ticks between two toggles
+
+// Timer1 compare B interrupt, only enabled while a tone is played: toggles the speaker at twice the frequency of the tone
+ISR(TIMER1_COMPB_vect) {
+  OCR1B += toneHalfPeriod; //next toggle half a period after this one, whatever the interrupt latency
+  SpeakerPin::toggle();
+  toneToggles -= 1;
+  if (toneToggles == 0) { //an even number of toggles, the speaker is low again
+    TIMSK1 &= ~_BV(OCIE1B);
+  }
+}
+#endif
+
+// Function used to play a tone on the speaker without waiting, tone() would take Timer2 from the green LED. The tone is dropped while
+// the pulse sequencer buzzes a question: another station's beep would add to the buzzes the player counts.
+void startTone(unsigned int frequency, unsigned int durationMs) {
+  if (Game::pulses.playing && Game::pulses.usesSpeaker()) {
+    return;
+  }
+#ifdef SPEEDMATH_HOST
+  tone(13, frequency, durationMs); //pin D13, recorded by the simulator
+#else
+  TIMSK1 &= ~_BV(OCIE1B); //the interrupt is off while the tone is replaced
+  SpeakerPin::low();
+  toneHalfPeriod = 1000000UL / frequency; //2 MHz ticks per half period
+  toneToggles = (unsigned int)(2UL * frequency * durationMs / 1000);
+  if (toneToggles != 0) {
+    OCR1B = TCNT1 + toneHalfPeriod;
+    TIFR1 = _BV(OCF1B); //drop a compare match left from before
+    TIMSK1 |= _BV(OCIE1B);
+  }
+#endif
+}
+
+// Function used to stop the tone being played, the speaker is left low
+void stopTone() {
+#ifdef SPEEDMATH_HOST
+  noTone(13);
+#else
+  TIMSK1 &= ~_BV(OCIE1B);
+  SpeakerPin::low();
+#endif
+}
+
+// Function used to check if a tone is being played
+bool tonePlaying() {
+#ifdef SPEEDMATH_HOST
+  return (simToneFrequency != 0) && (simToneEnd > simMicros);
+#else
+  return (TIMSK1 & _BV(OCIE1B)) != 0;
+#endif
+}
+
+// Function used to run Timer2 in phase-correct PWM mode with the green LED on its compare A output, OCR2A alone sets the brightness
+void startGreenPwm() {
+#ifdef SPEEDMATH_HOST
+  ioRegister<0xB0>() = 0x81; //TCCR2A with COM2A1 and WGM20, the simulator reads the green LED from it
+#else
+  TCCR2A = _BV(COM2A1) | _BV(WGM20); //phase-correct PWM, OC2A low from OCR2A up to the top: 0 is always off, 255 always on
+  TCCR2B = _BV(CS22); //16 MHz / 64 / 510 = 490 Hz, like analogWrite()
+#endif
+  GreenPwm::write(0); //off
+}
+
+// Function used to start scanning the keypad in the background
+void startKeypadTimer() {
+#ifdef SPEEDMATH_HOST
+  simMillisecondHook = scanKeypad; //called by the virtual clock
+#else
+  OCR0B = 0x80; //halfway through the Timer0 period, away from the millis() interrupt
+  TIMSK0 |= _BV(OCIE0B); //enable the compare B interrupt
+#endif
+}
+
+#ifndef SPEEDMATH_HOST
+// Bytes received by the serial port interrupt, a chunk of a replayed session arrives faster than loop() polls
+const byte UART_RING = 16; //a power of two, more than a chunk of a replayed session
+volatile byte uartRing[UART_RING];
+volatile byte uartHead = 0; //next byte to write, only changed by the interrupt
+volatile byte uartTail = 0; //next byte to read, only changed by loop()
+
+// Serial port receive interrupt, a byte that does not fit is dropped (the CRC of the chunk catches it)
+ISR(USART_RX_vect) {
+  byte value = UDR0;
+  byte next = (uartHead + 1) & (UART_RING - 1);
+  if (next != uartTail) {
+    uartRing[uartHead] = value;
+    uartHead = next;
+  }
+}
+#endif
+
+// Function used to start the serial port at 115200 baud with only its receiver on: TX is PD1, the IR sensor input
+void uartBegin() {
+#ifndef SPEEDMATH_HOST
+  UCSR0A = _BV(U2X0); //double speed, 2.1% error at 115200 baud like the Arduino core
+  UBRR0 = 16; //16 MHz / (8 * 115200) - 1
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); //8 data bits, no parity, 1 stop bit
+  UCSR0B = _BV(RXEN0) | _BV(RXCIE0); //receiver only, PD1 stays an input, each byte is taken by the interrupt
+#endif
+}
+
+// Function used to read a byte from the serial port, returns false if none has arrived
+bool uartReceive(byte &value) {
+#ifdef SPEEDMATH_HOST
+  return simUartReceive(value);
+#else
+  if (uartTail == uartHead) { //nothing received
+    return false;
+  }
+  value = uartRing[uartTail];
+  uartTail = (uartTail + 1) & (UART_RING - 1);
+  return true;
+#endif
+}
+
+// Function used to let the transmitter drive PD1. The IR module output still pulls PD1 low while it sees something, so it must reach
+// PD1 through a series resistor (1 kOhm, see README): TX then wins and the module only sinks 5 mA instead of shorting the pin.
+void uartClaim() {
+#ifndef SPEEDMATH_HOST
+  UCSR0A |= _BV(TXC0); //clear the transmit complete flag (written with a one)
+  UCSR0B |= _BV(TXEN0); //TX takes PD1 over
+#endif
+}
+
+// Function used to write a byte if the transmit buffer has room, returns false instead of waiting
+bool uartWrite(byte value) {
+#ifdef SPEEDMATH_HOST
+  simUartSend(&value, 1);
+#else
+  if (!(UCSR0A & _BV(UDRE0))) { //the previous byte is still waiting
+    return false;
+  }
+  UDR0 = value;
+  UCSR0A |= _BV(TXC0); //a gap before this byte must not count as the end of the transmission
+#endif
+  return true;
+}
+
+// Function used to give PD1 back to the IR sensor once the last stop bit has left, returns false until then
+bool uartRelease() {
+#ifndef SPEEDMATH_HOST
+  if (!(UCSR0A & _BV(TXC0))) { //still sending
+    return false;
+  }
+  UCSR0B &= ~_BV(TXEN0); //PD1 goes back to the IR sensor
+#endif
+  return true;
+}
+
+// Function used to check if the transmitter drives PD1, the IR sensor cannot be read meanwhile
+bool uartTransmitting() {
+#ifdef SPEEDMATH_HOST
+  return false; //the simulated bytes leave at once
+#else
+  return UCSR0B & _BV(TXEN0);
+#endif
+}
+
+// Function used to send a block of bytes, the transmitter only drives PD1 while the block is sent
+void uartSend(const byte *data, unsigned int length) {
+  uartClaim();
+  for (unsigned int i = 0; i < length; i++) {
+    while (!uartWrite(data[i])); //wait for room in the transmit buffer
+  }
+  while (!uartRelease()); //wait for the last stop bit
+}
+
+#ifndef SPEEDMATH_HOST
+volatile unsigned int watchdogStamp; //Timer1 count at the last watchdog interrupt
+volatile byte watchdogTicks = 0; //watchdog interrupts since the seed started being gathered
+
+// Watchdog interrupt, only enabled while the seed is gathered. The watchdog runs from its own 128 kHz RC oscillator, so where its
+// periods end on the crystal-driven Timer1 drifts with temperature and noise, from one board and one power-up to the next.
+ISR(WDT_vect) {
+  watchdogStamp = TCNT1;
+  watchdogTicks++;
+}
+#endif
+
+#ifndef SPEEDMATH_HOST
+extern byte __heap_start; //first byte after the variables, nothing is allocated so the stack may grow down to it
+#endif
+
+// Byte written to the free SRAM by paintStack(), the stack overwrites it as it grows
+const byte STACK_PAINT = 0xC5;
+
+// Function used to fill the SRAM between the variables and the stack pointer with STACK_PAINT, called first thing in setup()
+void paintStack() {
+#ifndef SPEEDMATH_HOST
+  for (byte *p = &__heap_start; p < (byte *)SP; p++) { //below SP nothing is in use yet
+    *p = STACK_PAINT;
+  }
+#endif
+}
+
+// Function used to get the most bytes the stack has taken: the painted bytes the stack never reached are still untouched
+unsigned int stackPeak() {
+#ifdef SPEEDMATH_HOST
+  return 0; //the stack of the simulator says nothing about the one of the board
+#else
+  const byte *p = &__heap_start;
+  while ((p <= (const byte *)RAMEND) && (*p == STACK_PAINT)) {
+    p++;
+  }
+  return (const byte *)RAMEND + 1 - p;
+#endif
+}
+
+// Function used to gather a seed: the Timer1 count at 16 watchdog interrupts (about 256 ms), the low bits of the potentiometer, and the
+// number of the latest score record so boards that power up the same way still differ once they have been played
+uint32_t gatherSeed() {
+  uint32_t seed = Game::scores.current.sequence;
+#ifndef SPEEDMATH_HOST
+  noInterrupts();
+  MCUSR &= ~_BV(WDRF); //a watchdog reset flag would keep the reset mode on
+  WDTCSR = _BV(WDCE) | _BV(WDE); //timed sequence to change the watchdog settings
+  WDTCSR = _BV(WDIE); //interrupt every 16 ms, no reset
+  interrupts();
+#endif
+  for (byte i = 0; i < 16; i++) {
+    unsigned int sample = analogRead(potentiometerPin); //the only analog input that is wired
+#ifdef SPEEDMATH_HOST
+    unsigned int jitter = micros(); //the virtual clock keeps the simulator repeatable
+#else
+    byte ticks = watchdogTicks;
+    while (watchdogTicks == ticks); //wait for the end of the next watchdog period
+    unsigned int jitter = watchdogStamp; //0.5 us ticks of the crystal at the end of a period of the RC oscillator
+#endif
+    seed = Game::Random::mix(seed ^ ((uint32_t)sample << 16) ^ jitter); //every bit of the reading changes the whole seed
+  }
+#ifndef SPEEDMATH_HOST
+  noInterrupts();
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = 0; //watchdog off
+  interrupts();
+#endif
+  return seed;
+}
+
+// Number of times the board went to sleep since power-up
+unsigned long sleepCount = 0;
+
+// Time the board stays awake after a wake-up or a byte received, the byte that wakes it up is lost so the host sends another one
+const unsigned int SERIAL_AWAKE_MS = 200;
+unsigned long awakeAt = 0; //millis() of the last wake-up or byte received
+
+#ifndef SPEEDMATH_HOST
+// Pin change interrupt of port D, only enabled for PD1 (IR sensor) and PD0 (RX) while sleeping, its only job is to wake the board up
+ISR(PCINT2_vect) {
+}
+#endif
+
+// Function used to check if every station waits for the IR sensor
+bool stationsIdle() {
+  for (byte i = 0; i < stationCount; i++) {
+    if (stations.at[i].game.phase != Game::SpeedMath::PHASE_IDLE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function used to check if the board has nothing left to do until someone comes
+bool canSleep() {
+  for (byte i = 0; i < stationCount; i++) {
+    if ((stations.at[i].queue.head != stations.at[i].queue.tail) || !stations.at[i].lcd.flushed()) { //a key or LCD cells still waiting
+      return false;
+    }
+  }
+  return stationsIdle() && !Game::scores.busy() && !Game::pulses.playing && !Game::events.busy() && !Game::session.replaying &&
+         !tonePlaying() && (millis() - awakeAt >= SERIAL_AWAKE_MS);
+}
+
+// Function used to sleep in power-down mode until the IR sensor output changes, the oscillator restarts in about 1 ms
+void sleepUntilIr() {
+  sleepCount += 1;
+#ifdef SPEEDMATH_HOST
+  simSleep(); //the simulator stops calling loop() until the IR pin changes
+#else
+  byte adcsra = ADCSRA; //ADC settings used by analogRead()
+  ADCSRA = 0; //ADC off, it would draw current in every sleep mode
+  ACSR |= _BV(ACD); //analog comparator off
+  DIDR0 = B00001111; //no digital input buffers on A0-A3 (potentiometer and floating pins)
+  PCMSK2 = _BV(PCINT17) | _BV(PCINT16); //PD1 and RX wake the board, not the keypad pins of port D
+  PCIFR = _BV(PCIF2); //forget the changes seen before
+  PCICR |= _BV(PCIE2);
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN); //every clock stops, Timer0 (millis() and the keypad scan) included
+  cli();
+  if (IrSensorPin::read()) { //nothing in front of the sensor, a change from now on still wakes the board
+    sleep_enable();
+    sleep_bod_disable(); //brown-out detector off while sleeping
+    sei(); //the instruction after sei() always runs, so a change that came in between wakes the board right away
+    sleep_cpu();
+    sleep_disable();
+  }
+  sei();
+  awakeAt = millis(); //a request may follow the byte that woke the board
+  PCICR &= ~_BV(PCIE2); //the sensor is polled again by loop()
+  DIDR0 = 0;
+  ACSR &= ~_BV(ACD);
+  ADCSRA = adcsra; //ADC back on for the potentiometer
+#endif
+}
+
+// Function used to count the stations wired to the board, a station is there if its LCD answers on the I2C bus
+byte countStations() {
+  byte count = 1; //the first station is always there
+  while (count < STATIONS) {
+    Wire.beginTransmission(LCD_ADDRESS - count);
+    if (Wire.endTransmission() != 0) { //no acknowledge, nothing at that address
+      break;
+    }
+    count += 1;
+  }
+  return count;
+}
 
 // Setup code here, to run once
 void setup() {
-  lcd.init(); //initialize the LCD
-  ptr_to_PORTD = 0x2B; //PORTD (port D) register address
-  ptr_to_PIND = 0x29; //PIND (port D) register address
-  *ptr_to_PORTD = B00000010; //sets IR pin in PD1 as input
-  ptr_to_DDRB = 0x24; //DDRB (port B) register address
-  ptr_to_PORTB = 0x25; //PORTB (port B) register address
-  *ptr_to_DDRB = B00111100; //sets speaker pin in PB5 and RGB pins in PB2/3/4 as output
-  randomSeed(analogRead(0)); //seeds the random number generator (AnalogRead on pin 0)
+  paintStack(); //the profiler frame reports how deep the stack has been
+  stations.at[0].lcd.init(); //initialize the LCD, and the I2C bus with it
+  stationCount = countStations(); //the other stations are found on the bus
+  for (byte i = 1; i < stationCount; i++) {
+    stations.at[i].lcd.init();
+  }
+  IrSensorPin::makeInput(true); //the open collector output of the IR sensor needs the pull-up
+  BluePin::makeOutput(); //RGB LED and speaker, the other pins of port B are left alone
+  GreenPin::makeOutput();
+  RedPin::makeOutput();
+  SpeakerPin::makeOutput();
+  startGreenPwm(); //Timer2 drives the green LED
+  Game::scores.begin(); //find the latest total scores in the EEPROM
+  startTimer1(); //time stamps of the profiler and ticks of the pulse sequencer
+  uint32_t seed = gatherSeed();
+  for (byte i = 0; i < stationCount; i++) {
+    stations.at[i].game.rng.seed(seed + i); //seeds the random number generators, a different sequence on every station
+  }
+  Game::events.begin(seed); //board id of the event stream
+  Game::session.begin(seed, stationCount, Game::scores.current); //record the inputs from now on
+  uartBegin(); //profile requests over the serial port, the events are sent on it
+  startKeypadTimer(); //scan the keypad from the timer interrupt
+}
+
+// Function used when a key is pressed on the Keypad of a station
+void handleKey(Game::SpeedMath &game, char key) {
+  Game::events.key(game.station, key, game.phase);
+  Game::session.input(game.station, Game::sessionInput(key)); //only while recording
+  // Switch statement used when a key is pressed on the Keypad
+  switch (key) {
+    case 'A': //if any of these are pressed the player profile changes
+    case 'B':
+    case 'C':
+      game.chooseProfile(key); //only on the difficulty menu
+      break;
+    case 'D': //if 'D' is pressed
+      game.deleteChar(); //delete the last character typed
+      break;
+    case '#': //if '#' is pressed
+      game.continueGame(); //check the answer then continue the game if there are questions left
+      break;
+    case '*': //if '*' is pressed
+      game.stopGame(); //stop the game
+      break;
+    default: //if a number is pressed
+      game.numPress(key); //write the number to the LCD or choose the level
+      break;
+  }
+}
+
+// IR sensor reading of the last loop(), set by the replayed inputs during a replay
+bool irDetected = false;
+
+// Function used to read the IR sensor and record its edges, during a replay the reading comes from the session
+bool readIrSensor() {
+  if (Game::session.replaying) {
+    return irDetected;
+  }
+  if (!uartTransmitting()) { //PD1 is TX while a frame is sent, the last reading stands meanwhile
+    bool detected = !IrSensorPin::read(); //active low
+    if (detected != irDetected) {
+      irDetected = detected;
+      Game::session.input(0, detected ? Game::INPUT_IR_ON : Game::INPUT_IR_OFF);
+    }
+  }
+  return irDetected;
+}
+
+// Function used to end a replay, the total scores are read from the EEPROM again
+void finishReplay(byte status) {
+  Game::session.finish(status);
+  Game::scores.frozen = false;
+  Game::scores.begin();
+  irDetected = false; //the real sensor is read again
+}
+
+// Function used to record again after a replay once nobody plays, the games start over like after setup() with a new seed so the host
+// cuts a new session out of the stream
+void restartRecording() {
+  uint32_t seed = Game::Random::mix(stations.at[0].game.rng.next() ^ micros()); //the replayed games left the generators in a known state
+  for (byte i = 0; i < stationCount; i++) {
+    stations.at[i].game.restart(seed + i);
+  }
+  Game::matchSeed = 0;
+  Game::session.begin(seed, stationCount, Game::scores.current);
+  if (irDetected) { //someone came in front of the sensor before the stations saw it
+    Game::session.input(0, Game::INPUT_IR_ON);
+  }
+}
+
+// Function used to start a replay when nobody plays, the games go back to their state after setup() once the header has arrived
+void startReplay() {
+  if (!stationsIdle() || !Game::pulses.idle() || Game::scores.busy()) {
+    Game::session.finish(Game::SessionLog::REPLAY_BUSY); //the 'D' frame says why
+    return;
+  }
+  Game::session.startReplay();
 }
 
-// Main code, to run repeatedly
+// Function used to move a replay forward: apply the header once it has arrived, then feed the inputs whose time has come
+void serviceReplay() {
+  Game::SessionLog &session = Game::session;
+  if (!session.replaying) {
+    return;
+  }
+  if (!session.started) {
+    byte version;
+    byte count;
+    uint32_t seed;
+    int16_t totals[Game::SCORE_PROFILES];
+    if (!session.header(version, count, seed, totals)) { //not arrived yet
+      if (session.ended) { //shorter than a header
+        finishReplay(Game::SessionLog::REPLAY_CORRUPT);
+      } else if (!session.service()) {
+        finishReplay(Game::SessionLog::REPLAY_TIMEOUT);
+      }
+      return;
+    }
+    if ((version != Game::SessionLog::VERSION) || (count != stationCount)) {
+      finishReplay(Game::SessionLog::REPLAY_STATIONS);
+      return;
+    }
+    for (byte i = 0; i < stationCount; i++) {
+      stations.at[i].game.restart(seed + i); //same seeds as setup() gave them
+    }
+    Game::matchSeed = 0;
+    Game::scores.frozen = true; //the replayed games must not change the saved totals
+    for (byte i = 0; i < Game::SCORE_PROFILES; i++) {
+      Game::scores.current.totals[i] = totals[i]; //totals of the recording
+    }
+    Game::events.outcome = Game::EventLog::OUTCOME_START;
+    irDetected = false;
+  }
+  byte station;
+  byte input;
+  while (session.next(station, input)) {
+    if (input == Game::INPUT_END) {
+      finishReplay(Game::SessionLog::REPLAY_OK);
+      return;
+    }
+    if ((input == Game::INPUT_IR_ON) || (input == Game::INPUT_IR_OFF)) {
+      irDetected = (input == Game::INPUT_IR_ON);
+    } else if (station < stationCount) {
+      handleKey(stations.at[station].game, pgm_read_byte(&Game::SESSION_KEYS[input]));
+    }
+  }
+  if (session.exhausted()) { //no end entry
+    finishReplay(Game::SessionLog::REPLAY_CORRUPT);
+  } else if (!session.service()) {
+    finishReplay(Game::SessionLog::REPLAY_TIMEOUT);
+  }
+}
+
+// Function used to answer the requests of the serial port: 'P' sends the profile, 'R' resets it, 'L' replays a session; during a
+// replay every byte received belongs to the session
+void serveSerial() {
+  byte request;
+  while (uartReceive(request)) {
+    awakeAt = millis(); //more requests may follow
+    if (Game::session.replaying) {
+      if (!Game::session.accept(request)) {
+        finishReplay(Game::SessionLog::REPLAY_CORRUPT);
+      }
+    } else if (request == 'L') {
+      startReplay();
+    } else if (request == 'P') {
+      byte frame[Game::Profiler::FRAME_SIZE];
+      Game::profiler.figures[Game::FIGURE_STACK_PEAK] = stackPeak();
+      Game::profiler.frame(frame);
+      Game::events.flush(); //an event frame being sent is finished first
+      uartSend(frame, sizeof(frame));
+    } else if (request == 'R') {
+      Game::profiler.reset();
+    }
+  }
+}
+
+// Main code, to run repeatedly: every iteration is the slice of one station, the stations take turns
 void loop() {
-  // Set up a timer based on difficulty level
-  my_game.setUpTimer();
-  byte statusIRSensor = *ptr_to_PIND; //digitalRead(IRSensor);
-  if (!my_game.setUp && ((statusIRSensor & B00000010) == LOW)) //if the game has not been set up and an object has been detected
-  {
-    my_game.setUpGame(); //set up the game
-  }
-  char key = keypad.getKey(); //value of a key being pressed
-  if (key) { //if a key has been pressed
-    // Switch statement used when a key is pressed on the Keypad
-    switch (key) {
-      case 'A': //if any of these are pressed nothing happens
-      case 'B':
-      case 'C':
-        break;
-      case 'D': //if 'D' is pressed
-        my_game.deleteChar(); //delete the last character typed
-        break;
-      case '#': //if '#' is pressed
-        my_game.continueGame(); //check the answer then continue the game if there are questions left
-        break;
-      case '*': //if '*' is pressed
-        my_game.stopGame(); //stop the game
-        break;
-      default: //if a number is pressed
-        my_game.numPress(key); //write the number to the LCD and retrieve a string of the numbers pressed
-        break;
+  unsigned long loopStart = micros(); //time this iteration started
+#if PROFILER_ENABLED
+  unsigned long loopTicks = profileTicks(); //same in profiler ticks
+#endif
+  serviceReplay(); //inputs of a replayed session whose time has come
+  if (readIrSensor()) { //an object has been detected, every station that has not been set up starts
+    if (Game::headToHead && stationsIdle()) { //nobody is playing, this is a new match
+      Game::matchSeed = my_game.rng.next();
+      for (byte i = 0; i < stationCount; i++) {
+        stations.at[i].game.startMatch();
+      }
+    }
+    for (byte i = 0; i < stationCount; i++) {
+      if (!stations.at[i].game.setUp) {
+        stations.at[i].game.setUpGame(); //set up the game
+      }
+    }
+  }
+  Station &station = stations.at[nextStation]; //station served by this iteration
+  if (nextStation != 0) { //the keypad of the first station is scanned by the timer interrupt
+    station.pad.poll(station.queue);
+  }
+  nextStation = (nextStation + 1 < stationCount) ? (nextStation + 1) : 0;
+  char key; //value of a key being pressed
+  unsigned long pressedAt; //micros() when the key was pressed
+  while (station.queue.pop(key, pressedAt)) { //every key pressed since the last slice of the station
+    if (Game::session.replaying) { //the keys come from the session
+      continue;
+    }
+    handleKey(station.game, key); //act on the key
+    unsigned long latency = micros() - pressedAt; //time the key waited
+    if (latency > station.worstKeyLatencyMicros) { //keep the worst case
+      station.worstKeyLatencyMicros = latency;
+    }
+    if (latency > worstKeyLatencyMicros) {
+      worstKeyLatencyMicros = latency;
+    }
+    station.keysHandled += 1;
+    keysHandled += 1;
+  }
+  station.game.update(); //move the game forward without blocking
+  Game::pulses.service(); //tell the station that played the blinks/buzzes when they are over
+  Game::scores.service(); //write the total scores to the EEPROM in the background
+  bool idle = stationsIdle(); //nobody plays
+  if (idle) {
+    if (!Game::session.recording && !Game::session.replaying && Game::pulses.idle() && !Game::scores.busy()) { //a replay has ended
+      restartRecording();
     }
+    Game::session.sync(); //the recorded inputs reach the host before the board sleeps
+  }
+  Game::events.service(idle); //send the game events in the background, at once when nobody plays
+  {
+    PROFILE_SCOPE(Game::PROBE_LCD_FLUSH);
+    station.lcd.flush(CELLS_PER_SLICE); //send the LCD cells that changed, the rest on the next iterations
+  }
+  Game::profiler.recordMost(Game::FIGURE_WORST_LOOP_US, micros() - loopStart); //duration of this iteration, the worst is kept
+#if PROFILER_ENABLED
+  Game::profiler.recordLoop(profileTicks() - loopTicks); //histogram of the iteration durations
+#endif
+  serveSerial(); //send the profile if it was asked for, after the iteration has been measured
+  if (canSleep()) { //the backlight and the LED are already off
+    sleepUntilIr(); //the next iteration sees the IR sensor and says "Hello!"
   }
 }
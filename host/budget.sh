@@ -0,0 +1,58 @@
+#!/bin/sh
+# ------------------------------------------------------------------------------------------------------------------------------------------
+#                                              SpeedMath Game - flash and SRAM budget check
+# ------------------------------------------------------------------------------------------------------------------------------------------
+# Fails when the static flash or SRAM usage of the sketch goes over its budget, so there is always room left for new features.
+# Usage (from the repository root): host/budget.sh [sketch.elf]
+# Without an ELF file, code.c is compiled for the Arduino Uno with arduino-cli (the arduino:avr core and the Keypad and LiquidCrystal_I2C
+# libraries must be installed). It is compiled as a C++ file of the sketch, the way the simulator compiles it, so the IDE does not add
+# function prototypes. EXTRA_FLAGS is passed to the compiler, for example "-DSTATIONS=2 -DHEAD_TO_HEAD=1".
+# The budgets can be changed with the FLASH_BUDGET and SRAM_BUDGET environment variables, in bytes.
+# avr-size is taken from the PATH, or else from the toolchain installed by arduino-cli. The report is also appended to the summary of the
+# GitHub Actions job when GITHUB_STEP_SUMMARY is set, so every CI run keeps the sizes of the real build.
+# Flash counts .text and .data (the initial values of the variables), SRAM counts .data and .bss. The rest of the 2048 bytes of SRAM is
+# left to the stack.
+# ------------------------------------------------------------------------------------------------------------------------------------------
+
+FLASH_BUDGET=${FLASH_BUDGET:-28672} # of the 32256 bytes left by the bootloader
+SRAM_BUDGET=${SRAM_BUDGET:-1536} # of the 2048 bytes, at least 512 bytes of stack
+
+elf=$1
+if [ -z "$elf" ]; then
+  work=$(mktemp -d) || exit 2
+  trap 'rm -rf "$work"' EXIT
+  mkdir "$work/speedmath" || exit 2
+  echo "// The sketch is in speedmath.cpp" > "$work/speedmath/speedmath.ino"
+  { echo "#include <Arduino.h>"; cat code.c; } > "$work/speedmath/speedmath.cpp" || exit 2
+  arduino-cli compile --fqbn arduino:avr:uno --warnings default --build-property "compiler.cpp.extra_flags=$EXTRA_FLAGS" \
+    --output-dir "$work/build" "$work/speedmath" > "$work/compile.log" 2>&1 || {
+    cat "$work/compile.log"
+    exit 2
+  }
+  elf="$work/build/speedmath.ino.elf"
+fi
+
+size=$(command -v avr-size || ls "${ARDUINO_DATA:-$HOME/.arduino15}"/packages/arduino/tools/avr-gcc/*/bin/avr-size 2>/dev/null | tail -n 1)
+if [ -z "$size" ]; then
+  echo "avr-size not found"
+  exit 2
+fi
+
+report=$("$size" -A "$elf" | awk -v flashBudget="$FLASH_BUDGET" -v sramBudget="$SRAM_BUDGET" '
+  $1 == ".text" { text = $2 }
+  $1 == ".data" { data = $2 }
+  $1 == ".bss" { bss = $2 }
+  END {
+    flash = text + data
+    sram = data + bss
+    printf "flash %6d / %6d bytes (.text %d + .data %d)\n", flash, flashBudget, text, data
+    printf "SRAM  %6d / %6d bytes (.data %d + .bss %d), %d bytes left to the stack\n", sram, sramBudget, data, bss, 2048 - sram
+    if (flash > flashBudget) { print "flash budget exceeded"; exit 1 }
+    if (sram > sramBudget) { print "SRAM budget exceeded"; exit 1 }
+  }')
+status=$?
+echo "$report"
+if [ -n "$GITHUB_STEP_SUMMARY" ]; then
+  { echo "### Uno ${EXTRA_FLAGS:-(one station)}"; echo '```'; "$size" -A "$elf"; echo "$report"; echo '```'; } >> "$GITHUB_STEP_SUMMARY"
+fi
+exit $status
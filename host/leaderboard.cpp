@@ -0,0 +1,367 @@
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/*                                                SpeedMath Game - event stream leaderboard                                                   */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/* Merges the event streams of any number of boards (serial ports or files saved by the simulator) and prints the accuracy of every player,   */
+/* the response time percentiles of every operation and a leaderboard.                                                                        */
+/* Build (from the repository root): g++ -O2 -o leaderboard host/leaderboard.cpp                                                              */
+/* Usage: ./leaderboard [-n top] [stream...]      reads every stream at once, "-" or no stream is the standard input                          */
+/* On the boards: stty -F /dev/ttyACM0 115200 raw -echo (same for each port), then ./leaderboard /dev/ttyACM0 /dev/ttyACM1, Ctrl-C reports    */
+/* The report is printed once every stream has ended or on Ctrl-C. The exit code is not 0 if no valid frame is found.                         */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+// Layout of the frames and records, see Game::EventLog in code.c
+const uint8_t FRAME_MAGIC = 0xA5;
+const uint8_t FRAME_TYPE = 'E';
+const uint8_t FRAME_VERSION = 1;
+const size_t HEADER_SIZE = 9;
+const size_t RECORD_SIZE = 12;
+
+// Types of the records, same as Game::EventType
+enum EventType { EVENT_QUESTION = 1, EVENT_KEY, EVENT_ANSWER, EVENT_GAME_END, EVENT_SESSION };
+
+// Signs of the operations, in the order of Game::OPERATIONS
+const char OPERATIONS[] = {'+', '-', 'x', '/'};
+
+// Statistics of one player, a player is a profile on a station of a board
+struct Player {
+  uint32_t key; //board, station and profile
+  unsigned long games; //games finished
+  unsigned long points; //sum of the game scores
+  unsigned int best; //best game score
+  unsigned long answers; //answers checked
+  unsigned long correct; //right answers
+  unsigned long timeouts; //answers checked because the timer ran out
+  uint64_t responseMs; //time spent answering, for the mean
+};
+
+// Statistics of one operation, the response times are kept as a histogram with one bucket per ms so percentiles are exact
+struct Operation {
+  unsigned long answers;
+  unsigned long correct;
+  std::vector<uint32_t> histogram; //answers per response time in ms
+};
+
+// Frame numbering of one board, to count the frames lost on the way
+struct Board {
+  long lastFrame; //number of the last frame, -1 before the first one
+  unsigned long frames;
+};
+
+// One input stream and the bytes not parsed yet
+struct Stream {
+  int fd;
+  const char *name;
+  std::vector<uint8_t> pending;
+  bool ended;
+};
+
+// Counters of the whole run
+struct Totals {
+  unsigned long long bytes;
+  unsigned long frames;
+  unsigned long records;
+  unsigned long crcErrors; //frames dropped because of a wrong CRC
+  unsigned long skipped; //bytes skipped to find the next frame
+  unsigned long framesLost; //gaps in the frame numbers
+  unsigned long recordsLost; //records the boards could not keep
+  unsigned long byType[6]; //records of each type (0 for the unknown ones)
+};
+
+static Totals totals;
+static std::unordered_map<uint32_t, Player> players;
+static std::unordered_map<uint16_t, Board> boards;
+static Operation operations[4];
+static volatile sig_atomic_t interrupted = 0;
+
+// Function used to stop reading on Ctrl-C, the report is still printed
+static void onSignal(int) {
+  interrupted = 1;
+}
+
+// Function used to compute the CRC-8 (polynomial 0x07) of a block of bytes, same as Game::crc8()
+static uint8_t crc8(const uint8_t *data, size_t length) {
+  uint8_t crc = 0;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Function used to read a little-endian value
+static uint32_t get(const uint8_t *p, int size) {
+  uint32_t value = 0;
+  for (int i = size - 1; i >= 0; i--) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+// Function used to find the statistics of a player, created empty the first time
+static Player &playerOf(uint16_t board, uint8_t station, uint8_t profile) {
+  uint32_t key = ((uint32_t)board << 16) | ((uint32_t)station << 8) | profile;
+  Player &player = players[key];
+  player.key = key;
+  return player;
+}
+
+// Function used to add a record of a board to the statistics
+static void addRecord(uint16_t board, const uint8_t *record) {
+  uint8_t type = record[0];
+  uint8_t station = record[1];
+  const uint8_t *data = record + 6;
+  totals.records++;
+  totals.byType[(type <= EVENT_SESSION) ? type : 0]++; //the session records are only counted, host/session.cpp reads them
+  if (type == EVENT_ANSWER) {
+    Player &player = playerOf(board, station, data[0]);
+    uint8_t op = data[1] & 0x03;
+    bool correct = (data[1] & 0x80) != 0;
+    uint16_t ms = get(data + 4, 2);
+    player.answers++;
+    player.correct += correct;
+    player.timeouts += (data[1] & 0x40) != 0;
+    player.responseMs += ms;
+    Operation &operation = operations[op];
+    operation.answers++;
+    operation.correct += correct;
+    operation.histogram[ms]++;
+  } else if (type == EVENT_GAME_END) {
+    Player &player = playerOf(board, station, data[0]);
+    player.games++;
+    player.points += data[2];
+    player.best = std::max<unsigned int>(player.best, data[2]);
+  }
+}
+
+// Function used to add a frame whose CRC has been checked
+static void addFrame(const uint8_t *frame) {
+  uint16_t id = get(frame + 3, 2);
+  uint16_t number = get(frame + 5, 2);
+  std::unordered_map<uint16_t, Board>::iterator found = boards.find(id);
+  if (found == boards.end()) {
+    found = boards.insert(std::make_pair(id, Board{-1, 0})).first;
+  }
+  Board &board = found->second;
+  if ((board.lastFrame >= 0) && (number != 0)) { //frame 0 comes after a reset of the board
+    totals.framesLost += (uint16_t)(number - board.lastFrame - 1);
+  }
+  board.lastFrame = number;
+  board.frames++;
+  totals.frames++;
+  totals.recordsLost += frame[7];
+  const uint8_t *record = frame + HEADER_SIZE;
+  for (uint8_t i = 0; i < frame[8]; i++, record += RECORD_SIZE) {
+    addRecord(id, record);
+  }
+}
+
+// Function used to take every whole frame out of the bytes of a stream, the bytes between frames are skipped; at the end of the
+// stream the bytes left are skipped too
+static void parse(Stream &stream, bool end) {
+  const uint8_t *data = stream.pending.data();
+  size_t size = stream.pending.size();
+  size_t start = 0;
+  while (start < size) {
+    const uint8_t *magic = (const uint8_t *)memchr(data + start, FRAME_MAGIC, size - start);
+    if (magic == 0) { //no frame in the rest
+      totals.skipped += size - start;
+      start = size;
+      break;
+    }
+    totals.skipped += magic - (data + start);
+    start = magic - data;
+    if (size - start < HEADER_SIZE) { //the header has not arrived yet
+      break;
+    }
+    if ((magic[1] != FRAME_TYPE) || (magic[2] != FRAME_VERSION)) { //another frame (the profile) or noise
+      totals.skipped++;
+      start++;
+      continue;
+    }
+    size_t frameSize = HEADER_SIZE + magic[8] * RECORD_SIZE + 1;
+    if (size - start < frameSize) { //the rest of the frame has not arrived yet
+      break;
+    }
+    if (crc8(magic, frameSize - 1) != magic[frameSize - 1]) {
+      totals.crcErrors++;
+      totals.skipped++;
+      start++;
+      continue;
+    }
+    addFrame(magic);
+    start += frameSize;
+  }
+  if (end) {
+    totals.skipped += size - start;
+    start = size;
+  }
+  stream.pending.erase(stream.pending.begin(), stream.pending.begin() + start);
+}
+
+// Function used to get the response time below which a share of the answers of an operation are
+static unsigned int percentile(const Operation &operation, double share) {
+  unsigned long long rank = (unsigned long long)(share * operation.answers + 0.999999); //ceil, at least the first answer
+  if (rank == 0) {
+    rank = 1;
+  }
+  unsigned long long seen = 0;
+  for (size_t ms = 0; ms < operation.histogram.size(); ms++) {
+    seen += operation.histogram[ms];
+    if (seen >= rank) {
+      return (unsigned int)ms;
+    }
+  }
+  return 0xFFFF;
+}
+
+// Function used to order the leaderboard: most right answers, then best accuracy, then fastest
+static bool ahead(const Player *a, const Player *b) {
+  if (a->correct != b->correct) {
+    return a->correct > b->correct;
+  }
+  double accuracyA = a->answers ? (double)a->correct / a->answers : 0.0;
+  double accuracyB = b->answers ? (double)b->correct / b->answers : 0.0;
+  if (accuracyA != accuracyB) {
+    return accuracyA > accuracyB;
+  }
+  double meanA = a->answers ? (double)a->responseMs / a->answers : 0.0;
+  double meanB = b->answers ? (double)b->responseMs / b->answers : 0.0;
+  if (meanA != meanB) {
+    return meanA < meanB;
+  }
+  return a->key < b->key;
+}
+
+// Function used to print the report
+static void report(size_t streams, double seconds, size_t top) {
+  printf("streams          %zu (%zu boards), %llu bytes, %lu frames, %lu records\n", streams, boards.size(), totals.bytes, totals.frames,
+         totals.records);
+  printf("errors           %lu CRC errors, %lu bytes skipped, %lu frames lost, %lu records lost on the boards\n", totals.crcErrors,
+         totals.skipped, totals.framesLost, totals.recordsLost);
+  printf("events           %lu questions, %lu keys, %lu answers, %lu games, %lu session, %lu unknown\n", totals.byType[EVENT_QUESTION],
+         totals.byType[EVENT_KEY], totals.byType[EVENT_ANSWER], totals.byType[EVENT_GAME_END], totals.byType[EVENT_SESSION],
+         totals.byType[0]);
+  if (seconds > 0) {
+    printf("rate             %.1f MB/s, %.0f records/s\n", totals.bytes / seconds / 1e6, totals.records / seconds);
+  }
+
+  printf("\n%-9s %10s %9s %9s %9s %9s\n", "operation", "answers", "correct", "p50 ms", "p90 ms", "p99 ms");
+  for (int op = 0; op < 4; op++) {
+    const Operation &operation = operations[op];
+    if (operation.answers == 0) {
+      printf("%-9c %10s %9s %9s %9s %9s\n", OPERATIONS[op], "-", "-", "-", "-", "-");
+      continue;
+    }
+    printf("%-9c %10lu %8.1f%% %9u %9u %9u\n", OPERATIONS[op], operation.answers, 100.0 * operation.correct / operation.answers,
+           percentile(operation, 0.50), percentile(operation, 0.90), percentile(operation, 0.99));
+  }
+
+  std::vector<const Player *> ranking;
+  for (std::unordered_map<uint32_t, Player>::const_iterator it = players.begin(); it != players.end(); ++it) {
+    ranking.push_back(&it->second);
+  }
+  std::sort(ranking.begin(), ranking.end(), ahead);
+  size_t shown = ((top == 0) || (top > ranking.size())) ? ranking.size() : top;
+  printf("\n%4s %-13s %7s %8s %8s %9s %9s %8s %7s %5s\n", "rank", "player", "games", "answers", "correct", "accuracy", "mean ms",
+         "timeouts", "points", "best");
+  for (size_t i = 0; i < shown; i++) {
+    const Player &player = *ranking[i];
+    char name[16];
+    snprintf(name, sizeof(name), "%04x/%u/%c", (unsigned int)(player.key >> 16), (unsigned int)((player.key >> 8) & 0xFF),
+             (char)('A' + (player.key & 0xFF)));
+    printf("%4zu %-13s %7lu %8lu %8lu %8.1f%% %9.0f %8lu %7lu %5u\n", i + 1, name, player.games, player.answers, player.correct,
+           player.answers ? 100.0 * player.correct / player.answers : 0.0,
+           player.answers ? (double)player.responseMs / player.answers : 0.0, player.timeouts, player.points, player.best);
+  }
+  if (shown < ranking.size()) {
+    printf("%4s %zu more players (-n 0 lists them all)\n", "", ranking.size() - shown);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t top = 10;
+  std::vector<Stream> streams;
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+      top = strtoul(argv[++i], 0, 10);
+      continue;
+    }
+    int fd = (strcmp(argv[i], "-") == 0) ? 0 : open(argv[i], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      fprintf(stderr, "cannot open %s: %s\n", argv[i], strerror(errno));
+      return 2;
+    }
+    streams.push_back(Stream{fd, argv[i], std::vector<uint8_t>(), false});
+  }
+  if (streams.empty()) {
+    streams.push_back(Stream{0, "-", std::vector<uint8_t>(), false});
+  }
+  for (int op = 0; op < 4; op++) {
+    operations[op].histogram.assign(0x10000, 0);
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<uint8_t> buffer(1 << 16);
+  size_t active = streams.size();
+  while ((active > 0) && !interrupted) {
+    std::vector<pollfd> fds;
+    std::vector<size_t> which;
+    for (size_t i = 0; i < streams.size(); i++) {
+      if (!streams[i].ended) {
+        fds.push_back(pollfd{streams[i].fd, POLLIN, 0});
+        which.push_back(i);
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) { //interrupted by a signal or failed
+      continue;
+    }
+    for (size_t f = 0; f < fds.size(); f++) {
+      if (fds[f].revents == 0) {
+        continue;
+      }
+      Stream &stream = streams[which[f]];
+      ssize_t got = read(stream.fd, buffer.data(), buffer.size());
+      if ((got < 0) && ((errno == EINTR) || (errno == EAGAIN))) {
+        continue;
+      }
+      if (got <= 0) { //end of the file or the port went away
+        parse(stream, true);
+        stream.ended = true;
+        active--;
+        continue;
+      }
+      totals.bytes += got;
+      stream.pending.insert(stream.pending.end(), buffer.data(), buffer.data() + got);
+      parse(stream, false);
+    }
+  }
+  for (size_t i = 0; i < streams.size(); i++) {
+    if (!streams[i].ended) {
+      parse(streams[i], true);
+    }
+    if (streams[i].fd != 0) {
+      close(streams[i].fd);
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  report(streams.size(), interrupted ? 0.0 : seconds, top);
+  return (totals.frames != 0) ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/*                                                  SpeedMath Game - profiler frame decoder                                                   */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/* Turns the profiler frame sent by the board (or saved by the simulator) into a readable report.                                             */
+/* Build (from the repository root): g++ -O2 -o profile_decode host/profile_decode.cpp                                                        */
+/* Usage: ./profile_decode [profile.bin]        reads the frame from a file or from the standard input                                        */
+/* On the board: stty -F /dev/ttyACM0 115200 raw -echo &&                                                                                     */
+/*   (printf '\377' > /dev/ttyACM0; sleep 0.05; printf P > /dev/ttyACM0; timeout 1 cat /dev/ttyACM0) | ./profile_decode                       */
+/* The first byte wakes a sleeping board up and is lost.                                                                                      */
+/* The exit code is not 0 if no valid frame is found.                                                                                         */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+// Layout of the frame, see Game::Profiler in code.c
+const uint8_t FRAME_MAGIC = 0xA5;
+const uint8_t FRAME_TYPE = 'P';
+const uint8_t FRAME_VERSION = 2;
+const size_t HEADER_SIZE = 8;
+
+// Names of the probes, in the order of Game::ProbeId
+const char *const PROBE_NAMES[] = {
+  "present LCD",
+  "present LED",
+  "present speaker",
+  "present LED+speaker",
+  "checkAnswer()",
+  "displayTimer()",
+  "scanKeypad() (ISR)",
+  "lcd.flush()"
+};
+const size_t PROBE_NAME_COUNT = sizeof(PROBE_NAMES) / sizeof(PROBE_NAMES[0]);
+
+// Names of the figures, in the order of Game::FigureId
+const char *const FIGURE_NAMES[] = {
+  "questions",
+  "question I2C bytes",
+  "most I2C bytes",
+  "worst loop() (us)",
+  "stack peak (bytes)"
+};
+const size_t FIGURE_NAME_COUNT = sizeof(FIGURE_NAMES) / sizeof(FIGURE_NAMES[0]);
+
+// Function used to compute the CRC-8 (polynomial 0x07) of a block of bytes, same as Game::crc8()
+static uint8_t crc8(const uint8_t *data, size_t length) {
+  uint8_t crc = 0;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Function used to read a little-endian value
+static uint32_t get(const uint8_t *p, int size) {
+  uint32_t value = 0;
+  for (int i = size - 1; i >= 0; i--) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+// Function used to print a duration given in ticks with a readable unit
+static void printDuration(double ticks, unsigned int tickNs) {
+  double ns = ticks * tickNs;
+  if (ns < 1e3) {
+    printf("%9.0f ns", ns);
+  } else if (ns < 1e6) {
+    printf("%9.1f us", ns / 1e3);
+  } else {
+    printf("%9.2f ms", ns / 1e6);
+  }
+}
+
+// Function used to print the report of a frame whose CRC has been checked
+static void report(const uint8_t *frame) {
+  uint8_t probes = frame[3];
+  uint8_t buckets = frame[4];
+  uint8_t figures = frame[5];
+  unsigned int tickNs = get(frame + 6, 2);
+  printf("tick             %u ns\n\n", tickNs);
+  printf("%-20s %10s %12s %12s %12s %12s\n", "probe", "count", "min", "mean", "max", "total");
+  const uint8_t *p = frame + HEADER_SIZE;
+  for (uint8_t i = 0; i < probes; i++, p += 16) {
+    uint32_t count = get(p, 4);
+    printf("%-20s %10u ", (i < PROBE_NAME_COUNT) ? PROBE_NAMES[i] : "?", count);
+    if (count == 0) {
+      printf("%12s %12s %12s %12s\n", "-", "-", "-", "-");
+      continue;
+    }
+    printDuration(get(p + 4, 4), tickNs);
+    printf(" ");
+    printDuration((double)get(p + 12, 4) / count, tickNs);
+    printf(" ");
+    printDuration(get(p + 8, 4), tickNs);
+    printf(" ");
+    printDuration(get(p + 12, 4), tickNs);
+    printf("\n");
+  }
+  uint32_t loops = 0;
+  uint32_t widest = 1;
+  for (uint8_t i = 0; i < buckets; i++) {
+    uint32_t count = get(p + 2 * i, 2);
+    loops += count;
+    if (count > widest) {
+      widest = count;
+    }
+  }
+  printf("\nloop() durations (%u iterations, scaled down by halves once a bucket is full)\n", loops);
+  for (uint8_t i = 0; i < buckets; i++) {
+    uint32_t count = get(p + 2 * i, 2);
+    if (count == 0) {
+      continue;
+    }
+    printDuration((double)(1UL << i), tickNs);
+    if (i + 1 < buckets) {
+      printf(" - ");
+      printDuration((double)(1UL << (i + 1)), tickNs);
+    } else {
+      printf(" and more  ");
+    }
+    printf(" %8u %5.1f%% ", count, 100.0 * count / loops);
+    for (uint32_t bar = 0; bar < (count * 40 + widest - 1) / widest; bar++) {
+      printf("#");
+    }
+    printf("\n");
+  }
+  p += 2 * buckets;
+  printf("\n");
+  for (uint8_t i = 0; i < figures; i++, p += 4) {
+    printf("%-20s %10u\n", (i < FIGURE_NAME_COUNT) ? FIGURE_NAMES[i] : "?", get(p, 4));
+  }
+  uint32_t questions = get(frame + HEADER_SIZE + probes * 16 + buckets * 2, 4);
+  if ((figures > 1) && (questions != 0)) { //the LCD traffic of a question, the figure to lower
+    printf("%-20s %10.1f\n", "I2C bytes/question", (double)get(frame + HEADER_SIZE + probes * 16 + buckets * 2 + 4, 4) / questions);
+  }
+}
+
+int main(int argc, char **argv) {
+  FILE *file = (argc > 1) ? fopen(argv[1], "rb") : stdin;
+  if (file == 0) {
+    fprintf(stderr, "cannot open %s\n", argv[1]);
+    return 2;
+  }
+  std::vector<uint8_t> data;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    data.push_back((uint8_t)c);
+  }
+  for (size_t start = 0; start + HEADER_SIZE <= data.size(); start++) { //look for a frame, noise and event frames may come first
+    const uint8_t *frame = data.data() + start;
+    if ((frame[0] != FRAME_MAGIC) || (frame[1] != FRAME_TYPE) || (frame[2] != FRAME_VERSION)) {
+      continue;
+    }
+    size_t size = HEADER_SIZE + frame[3] * 16 + frame[4] * 2 + frame[5] * 4 + 1;
+    if ((start + size > data.size()) || (crc8(frame, size - 1) != frame[size - 1])) {
+      continue;
+    }
+    report(frame);
+    return 0;
+  }
+  fprintf(stderr, "no valid profiler frame in %zu bytes\n", data.size());
+  return 1;
+}
@@ -0,0 +1,437 @@
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/*                                                 SpeedMath Game - recorded session tool                                                     */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/* Cuts the sessions recorded by the boards out of their event streams into compact files, prints them, and replays them on a board.          */
+/* Build (from the repository root): g++ -O2 -o session host/session.cpp                                                                      */
+/* Usage: ./session extract prefix [stream...]   writes prefix-BOARD-N.ses for every session of the streams (standard input if none)          */
+/*        ./session dump file.ses                prints the header and the inputs of a session                                                */
+/*        ./session play port file.ses...        replays the sessions on the board at the serial port, one after the other                    */
+/* A session file is the session sent by the board (see Game::SessionLog in code.c), an end entry, and the FNV-1a outcome of the questions,   */
+/* answers and game ends logged while it was recorded. The simulator replays the same files with ./speedmath_sim replay file.ses...           */
+/* The exit code is not 0 if nothing was extracted or if a replay does not end with the recorded outcome.                                     */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+// Layout of the event frames and records, see Game::EventLog in code.c
+const uint8_t FRAME_MAGIC = 0xA5;
+const uint8_t FRAME_VERSION = 1;
+const size_t HEADER_SIZE = 9;
+const size_t RECORD_SIZE = 12;
+enum EventType { EVENT_QUESTION = 1, EVENT_KEY, EVENT_ANSWER, EVENT_GAME_END, EVENT_SESSION };
+
+// Layout of the sessions and of the replay frames, see Game::SessionLog in code.c
+const uint8_t SESSION_VERSION = 1;
+const size_t SESSION_HEADER_SIZE = 16;
+const size_t REQUEST_SIZE = 4;
+const size_t DONE_SIZE = 11;
+const char SESSION_KEYS[] = "0123456789ABCD*#";
+enum SessionInput { INPUT_IR_ON = 16, INPUT_IR_OFF, INPUT_END = 31 };
+const char *const STATUS_NAMES[] = {"ok", "corrupt", "other stations or version", "timeout", "busy"};
+
+// Function used to compute the CRC-8 (polynomial 0x07) of a block of bytes, same as Game::crc8()
+static uint8_t crc8(const uint8_t *data, size_t length) {
+  uint8_t crc = 0;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Function used to read a little-endian value
+static uint32_t get(const uint8_t *p, int size) {
+  uint32_t value = 0;
+  for (int i = size - 1; i >= 0; i--) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+// Function used to add a byte to an FNV-1a hash, same as Game::EventLog::hash()
+static uint32_t hash(uint32_t outcome, uint8_t value) {
+  return (outcome ^ value) * 16777619UL;
+}
+
+// Function used to write a varint, 7 bits per byte with bit 7 set when another byte follows
+static void putVarint(std::vector<uint8_t> &out, uint32_t value) {
+  do {
+    uint8_t low = value & 0x7F;
+    value >>= 7;
+    out.push_back(low | ((value != 0) ? 0x80 : 0));
+  } while (value != 0);
+}
+
+// One input of a session
+struct Entry {
+  uint32_t at; //ms since the start of the session
+  uint8_t station;
+  uint8_t input;
+};
+
+// Function used to parse the entries of a session, returns false if the last one is cut
+static bool parseEntries(const uint8_t *data, size_t size, std::vector<Entry> &entries) {
+  uint32_t at = 0;
+  size_t i = SESSION_HEADER_SIZE;
+  while (i < size) {
+    uint32_t delta = 0;
+    int shift = 0;
+    while ((i < size) && (data[i] & 0x80)) {
+      delta |= (uint32_t)(data[i++] & 0x7F) << shift;
+      shift += 7;
+    }
+    if (i + 1 >= size) { //no last varint byte or no input byte
+      return false;
+    }
+    delta |= (uint32_t)(data[i++] & 0x7F) << shift;
+    at += delta;
+    entries.push_back(Entry{at, (uint8_t)(data[i] >> 5), (uint8_t)(data[i] & 0x1F)});
+    i++;
+  }
+  return true;
+}
+
+// Session being cut out of the stream of a board
+struct Recording {
+  bool active; //if a session has started
+  bool damaged; //if records or frames were lost since it started
+  std::vector<uint8_t> bytes; //session bytes received so far
+  size_t syncedSize; //bytes up to the last point where every input had been logged
+  uint32_t syncedTime; //millis() of the board at that point
+  uint32_t syncedOutcome; //outcome at that point
+  uint32_t outcome; //outcome of the records since the session started
+  bool seen; //if a frame of the board has been read
+  uint16_t lastFrame; //number of the last frame
+  unsigned int written; //sessions written for this board
+};
+
+// Function used to write a session cut at its last synced point, returns false if there is nothing to write
+static bool writeSession(const char *prefix, uint16_t board, Recording &recording) {
+  if (!recording.active) {
+    return false;
+  }
+  recording.active = false;
+  if (recording.damaged || (recording.syncedSize < SESSION_HEADER_SIZE)) {
+    fprintf(stderr, "board %04x: session %u skipped (%s)\n", board, recording.written + 1,
+            recording.damaged ? "records were lost" : "never synced");
+    return false;
+  }
+  std::vector<uint8_t> out(recording.bytes.begin(), recording.bytes.begin() + recording.syncedSize);
+  std::vector<Entry> entries;
+  if ((out[0] != SESSION_VERSION) || !parseEntries(out.data(), out.size(), entries)) {
+    fprintf(stderr, "board %04x: session %u skipped (not a valid session)\n", board, recording.written + 1);
+    return false;
+  }
+  uint32_t origin = get(out.data() + 12, 4);
+  uint32_t end = recording.syncedTime - origin + 1; //after everything the board logged until then
+  uint32_t last = entries.empty() ? 0 : entries.back().at;
+  putVarint(out, (end > last) ? (end - last) : 0);
+  out.push_back(INPUT_END);
+  for (int i = 0; i < 4; i++) {
+    out.push_back((uint8_t)(recording.syncedOutcome >> (8 * i)));
+  }
+  recording.written++;
+  char name[512];
+  snprintf(name, sizeof(name), "%s-%04x-%u.ses", prefix, board, recording.written);
+  FILE *file = fopen(name, "wb");
+  if ((file == 0) || (fwrite(out.data(), 1, out.size(), file) != out.size())) {
+    fprintf(stderr, "cannot write %s\n", name);
+    exit(2);
+  }
+  fclose(file);
+  printf("%s: %zu bytes, %zu inputs, %.1f s\n", name, out.size(), entries.size(), end / 1000.0);
+  return true;
+}
+
+// Function used to add an event frame whose CRC has been checked to the recording of its board
+static unsigned int addFrame(const char *prefix, const uint8_t *frame, std::map<uint16_t, Recording> &recordings) {
+  unsigned int written = 0;
+  uint16_t board = get(frame + 3, 2);
+  uint16_t number = get(frame + 5, 2);
+  Recording &recording = recordings[board];
+  if (recording.seen && (number != 0) && ((uint16_t)(number - recording.lastFrame) != 1)) { //frame 0 comes after a reset
+    recording.damaged = true; //frames lost
+  }
+  recording.seen = true;
+  recording.lastFrame = number;
+  if (frame[7] != 0) { //records lost on the board
+    recording.damaged = true;
+  }
+  const uint8_t *record = frame + HEADER_SIZE;
+  for (uint8_t i = 0; i < frame[8]; i++, record += RECORD_SIZE) {
+    uint8_t type = record[0];
+    const uint8_t *data = record + 6;
+    if ((type == EVENT_SESSION) && (data[0] & 0x80)) { //a new session: the board was reset or a replay ended
+      written += writeSession(prefix, board, recording);
+      recording.active = true;
+      recording.damaged = false;
+      recording.bytes.clear();
+      recording.syncedSize = 0;
+      recording.outcome = 2166136261UL;
+    }
+    if (!recording.active) { //records of a session that started before the stream
+      continue;
+    }
+    if ((type == EVENT_QUESTION) || (type == EVENT_ANSWER) || (type == EVENT_GAME_END)) {
+      int fields = (type == EVENT_ANSWER) ? 4 : 6;
+      recording.outcome = hash(recording.outcome, type);
+      recording.outcome = hash(recording.outcome, record[1]);
+      for (int f = 0; f < fields; f++) {
+        recording.outcome = hash(recording.outcome, data[f]);
+      }
+    } else if (type == EVENT_SESSION) {
+      recording.bytes.insert(recording.bytes.end(), data + 1, data + 1 + (data[0] & 0x07));
+      if ((data[0] & 0x40) && !recording.damaged) { //every input so far has been logged
+        recording.syncedSize = recording.bytes.size();
+        recording.syncedTime = get(record + 2, 4);
+        recording.syncedOutcome = recording.outcome;
+      }
+    }
+  }
+  return written;
+}
+
+// Function used to cut the sessions out of event streams
+static int extract(const char *prefix, int count, char **paths) {
+  std::map<uint16_t, Recording> recordings;
+  unsigned int written = 0;
+  for (int s = 0; s < ((count > 0) ? count : 1); s++) {
+    FILE *file = (count > 0) ? fopen(paths[s], "rb") : stdin;
+    if (file == 0) {
+      fprintf(stderr, "cannot open %s\n", paths[s]);
+      return 2;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.insert(data.end(), buffer, buffer + got);
+    }
+    if (file != stdin) {
+      fclose(file);
+    }
+    size_t i = 0;
+    while (i + HEADER_SIZE <= data.size()) { //look for the event frames, anything else is skipped
+      const uint8_t *frame = data.data() + i;
+      size_t size = HEADER_SIZE + frame[8] * RECORD_SIZE + 1;
+      if ((frame[0] != FRAME_MAGIC) || (frame[1] != 'E') || (frame[2] != FRAME_VERSION) || (i + size > data.size()) ||
+          (crc8(frame, size - 1) != frame[size - 1])) {
+        i++;
+        continue;
+      }
+      written += addFrame(prefix, frame, recordings);
+      i += size;
+    }
+  }
+  for (std::map<uint16_t, Recording>::iterator it = recordings.begin(); it != recordings.end(); ++it) {
+    written += writeSession(prefix, it->first, it->second);
+  }
+  printf("%u sessions written\n", written);
+  return (written != 0) ? 0 : 1;
+}
+
+// Function used to read a session file, the outcome is split from the bytes sent to the board
+static bool readSession(const char *path, std::vector<uint8_t> &bytes, uint32_t &outcome) {
+  FILE *file = fopen(path, "rb");
+  if (file == 0) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  uint8_t buffer[65536];
+  size_t got;
+  while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    bytes.insert(bytes.end(), buffer, buffer + got);
+  }
+  fclose(file);
+  if ((bytes.size() < SESSION_HEADER_SIZE + 2 + 4) || (bytes[0] != SESSION_VERSION)) {
+    fprintf(stderr, "%s is not a session\n", path);
+    return false;
+  }
+  outcome = get(bytes.data() + bytes.size() - 4, 4);
+  bytes.resize(bytes.size() - 4);
+  return true;
+}
+
+// Function used to print a session
+static int dump(const char *path) {
+  std::vector<uint8_t> bytes;
+  uint32_t outcome;
+  std::vector<Entry> entries;
+  if (!readSession(path, bytes, outcome) || !parseEntries(bytes.data(), bytes.size(), entries)) {
+    return 1;
+  }
+  const uint8_t *h = bytes.data();
+  printf("version %u, %u stations, seed %08x, totals %d %d %d, outcome %08x\n", h[0], h[1], get(h + 2, 4), (int16_t)get(h + 6, 2),
+         (int16_t)get(h + 8, 2), (int16_t)get(h + 10, 2), outcome);
+  for (size_t i = 0; i < entries.size(); i++) {
+    const Entry &entry = entries[i];
+    printf("%10.3f s  station %u  ", entry.at / 1000.0, entry.station);
+    if (entry.input < 16) {
+      printf("key %c\n", SESSION_KEYS[entry.input]);
+    } else if (entry.input == INPUT_IR_ON) {
+      printf("IR on\n");
+    } else if (entry.input == INPUT_IR_OFF) {
+      printf("IR off\n");
+    } else if (entry.input == INPUT_END) {
+      printf("end\n");
+    } else {
+      printf("input %u\n", entry.input);
+    }
+  }
+  return 0;
+}
+
+// Function used to write every byte to the serial port
+static bool writeAll(int fd, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    ssize_t done = write(fd, data, size);
+    if (done < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += done;
+    size -= done;
+  }
+  return true;
+}
+
+// Function used to replay a session on the board: answer its requests with chunks until it sends its 'D' frame
+static bool play(int fd, const char *path) {
+  std::vector<uint8_t> bytes;
+  uint32_t outcome;
+  if (!readSession(path, bytes, outcome)) {
+    return false;
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  uint8_t wake = 0xFF; //a sleeping board wakes up on this byte and loses it, an awake one ignores it
+  uint8_t command = 'L';
+  if (!writeAll(fd, &wake, 1)) {
+    fprintf(stderr, "cannot write to the board\n");
+    return false;
+  }
+  usleep(20000); //the oscillator of a sleeping board starts in about 1 ms
+  if (!writeAll(fd, &command, 1)) {
+    fprintf(stderr, "cannot write to the board\n");
+    return false;
+  }
+  std::vector<uint8_t> in;
+  size_t sent = 0;
+  while (true) {
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 5000) <= 0) {
+      fprintf(stderr, "%s: the board stopped answering\n", path);
+      return false;
+    }
+    uint8_t buffer[4096];
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    if (got <= 0) {
+      fprintf(stderr, "%s: the port was closed\n", path);
+      return false;
+    }
+    in.insert(in.end(), buffer, buffer + got);
+    size_t i = 0;
+    while (i + REQUEST_SIZE <= in.size()) {
+      const uint8_t *frame = in.data() + i;
+      if (frame[0] != FRAME_MAGIC) {
+        i++;
+        continue;
+      }
+      if ((frame[1] == 'E') && (frame[2] == FRAME_VERSION) && (i + HEADER_SIZE <= in.size())) { //events, skipped whole
+        size_t size = HEADER_SIZE + frame[8] * RECORD_SIZE + 1;
+        if (i + size > in.size()) {
+          break; //wait for the rest
+        }
+        i += (crc8(frame, size - 1) == frame[size - 1]) ? size : 1;
+      } else if ((frame[1] == 'N') && (crc8(frame, REQUEST_SIZE - 1) == frame[REQUEST_SIZE - 1])) {
+        size_t length = bytes.size() - sent;
+        if (length > frame[2]) {
+          length = frame[2];
+        }
+        uint8_t chunk[258]; //length, bytes and CRC-8
+        chunk[0] = (uint8_t)length;
+        memcpy(chunk + 1, bytes.data() + sent, length);
+        chunk[length + 1] = crc8(chunk, length + 1);
+        if (!writeAll(fd, chunk, length + 2)) {
+          fprintf(stderr, "cannot write to the board\n");
+          return false;
+        }
+        sent += length;
+        i += REQUEST_SIZE;
+      } else if ((frame[1] == 'D') && (i + DONE_SIZE <= in.size())) {
+        if (crc8(frame, DONE_SIZE - 1) != frame[DONE_SIZE - 1]) {
+          i++;
+          continue;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint8_t status = frame[3];
+        uint32_t replayed = get(frame + 4, 4);
+        printf("%s: %s, %u inputs in %.1f s, outcome %08x %s %08x\n", path, (status < 5) ? STATUS_NAMES[status] : "?",
+               get(frame + 8, 2), seconds, replayed, (replayed == outcome) ? "==" : "!=", outcome);
+        return (status == 0) && (replayed == outcome);
+      } else if ((frame[1] == 'E') || (frame[1] == 'D')) {
+        break; //wait for the rest
+      } else {
+        i++;
+      }
+    }
+    in.erase(in.begin(), in.begin() + i);
+  }
+}
+
+// Function used to open the serial port of a board at 115200 baud, raw
+static int openPort(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  termios tty;
+  if (tcgetattr(fd, &tty) == 0) { //not a terminal when testing with a pipe or a file
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B115200);
+    cfsetospeed(&tty, B115200);
+    tcsetattr(fd, TCSANOW, &tty);
+    sleep(2); //opening the port resets an Uno, wait for the bootloader to start the sketch
+    tcflush(fd, TCIFLUSH);
+  }
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  if ((argc >= 3) && (strcmp(argv[1], "extract") == 0)) {
+    return extract(argv[2], argc - 3, argv + 3);
+  }
+  if ((argc == 3) && (strcmp(argv[1], "dump") == 0)) {
+    return dump(argv[2]);
+  }
+  if ((argc >= 4) && (strcmp(argv[1], "play") == 0)) {
+    int fd = openPort(argv[2]);
+    if (fd < 0) {
+      return 2;
+    }
+    int failed = 0;
+    for (int i = 3; i < argc; i++) {
+      failed += !play(fd, argv[i]);
+    }
+    close(fd);
+    return (failed == 0) ? 0 : 1;
+  }
+  fprintf(stderr, "usage: %s extract prefix [stream...] | dump file.ses | play port file.ses...\n", argv[0]);
+  return 2;
+}
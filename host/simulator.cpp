@@ -0,0 +1,1212 @@
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/*                                                    SpeedMath Game - Linux simulator                                                        */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/* Runs the unchanged game logic of code.c against the mocks of host/simulator.h with a scripted player.                                      */
+/* The virtual clock jumps straight to the next deadline of the game or of the player, so no time is spent waiting.                           */
+/* Build (from the repository root): g++ -O2 -o speedmath_sim host/simulator.cpp                                                              */
+/* Usage: ./speedmath_sim [games] [seed] [profile.bin] [events.bin]  plays games with a scripted player, checks the event stream, then saves  */
+/*                                                                    the profiler frame and the events                                       */
+/*        ./speedmath_sim keys [presses] [ms]           types 20 keys per second with rollover while loop() only runs every ms milliseconds   */
+/*        ./speedmath_sim prng [draws]                  times the random number generator and tests the uniformity of the operands            */
+/*        ./speedmath_sim pins [count]                  times setColor() against analogWrite() and checks they light the LED the same way     */
+/*        ./speedmath_sim stations [count] [matches]    plays head-to-head matches on several stations and checks the latency of their keys   */
+/*        ./speedmath_sim bench [results.json] [baseline.json]  benchmarks the game loop and compares the results with a baseline             */
+/*        ./speedmath_sim replay file.ses...            replays sessions saved by host/session.cpp and checks their outcome                   */
+/* The exit code is not 0 if a game ends with a score that does not match the answers typed by the player, or a replay with another outcome.  */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+
+#define SPEEDMATH_HOST
+#include "../code.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+// Heap allocations of the whole program: malloc() is replaced so the simulator can check that loop() never allocates. On the board the
+// heap grows towards the stack, so the game only uses static memory.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *block, size_t size);
+unsigned long simAllocations = 0;
+
+extern "C" void *malloc(size_t size) noexcept {
+  simAllocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept {
+  simAllocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *block, size_t size) noexcept {
+  simAllocations++;
+  return __libc_realloc(block, size);
+}
+
+// State of the simulated hardware
+uint64_t simMicros = 0;
+byte hostRegisters[0x100];
+unsigned int simToneFrequency = 0;
+uint64_t simToneEnd = 0;
+unsigned long simToneCount = 0;
+int simAnalog[8] = {512, 512, 512, 512, 512, 512, 512, 512};
+uint32_t simRandomState = 1;
+SimDisplay simDisplays[STATIONS];
+SimDisplay &simDisplay = simDisplays[0];
+byte simStations = 1;
+unsigned long simBusBytes = 0;
+unsigned long simBusMark = 0;
+bool simBusTimed = false;
+byte simExpanderPins[STATIONS]; //last byte written to the keypad expander of each station
+TwoWire Wire;
+byte simKeyDown[STATIONS][128];
+SimTypist simTypists[STATIONS];
+SimTypist &simTypist = simTypists[0];
+void (*simMillisecondHook)() = 0;
+unsigned long (*simTimer1Hook)(unsigned long ticks) = 0;
+bool simAsleep = false;
+uint64_t simSleepMicros = 0;
+std::vector<byte> simUartRx;
+std::vector<byte> simUartTx;
+EEPROMClass EEPROM;
+
+typedef Game::SpeedMath Sm;
+
+// Scripted player, answers every question after a short think time
+struct SimPlayer {
+  uint32_t state; //random state of the player (independent from the game)
+  byte accuracy; //percentage of correct answers
+  unsigned long thinkMs; //time taken before typing an answer
+  unsigned long idleMs; //time nobody plays between two games
+  uint64_t actAt; //virtual time of the next action, 0 if none is planned
+  byte answered; //number of correct answers typed in the current game
+  byte quitAt; //questions answered before the player presses '*', 0 to play every game to the end
+  byte quitLate; //every how many games the player presses '*' on the last result or on the score screen, 0 never
+  int totalBefore; //total score of the profile when the game started
+  bool checkTotal; //if the total score must have grown by the right answers once the game is stopped
+
+  // Function used to draw a random number [0, n) for the player
+  unsigned int draw(unsigned int n) {
+    state = state * 1103515245UL + 12345UL;
+    return (state >> 16) % n;
+  }
+};
+
+// Counters of a simulation run
+struct SimStats {
+  unsigned long games;
+  unsigned long questions;
+  unsigned long loops;
+  unsigned long mismatches;
+  double hostSeconds;
+  double worstLoopNs;
+  unsigned long deckDuplicates;
+  unsigned long deckErrors;
+  uint64_t idleMicros; //virtual time spent in PHASE_IDLE
+  unsigned long wakeUps; //times the IR sensor woke the board
+  unsigned long wakeBusBytes; //LCD bus bytes when the board was woken
+  unsigned long worstWakeBytes; //most LCD bus bytes sent until "Hello!" after a wake-up
+  bool waking; //if the board has just been woken
+  unsigned long exits; //games left with '*' before the end
+  unsigned long allocations; //heap allocations made by loop(), the event buffer of the simulator aside
+  unsigned long lateExits; //games left with '*' on the last result or on the score screen
+  unsigned long lostScores; //games left that way whose score was not added to the total
+};
+
+// Decks of the current head-to-head match: the n-th game a station starts on the level of the match must get the n-th deck, and
+// a station that plays again must get a new deck
+const byte SIM_MATCH_DECKS = 16;
+Game::QuestionDeck simMatchDecks[SIM_MATCH_DECKS];
+byte simMatchDealt = 0; //decks in simMatchDecks
+byte simMatchGames[STATIONS]; //games each station has started in the current match
+
+// Function used to check the deck of a game: every answer must be right and no question may come twice
+static void simCheckDeck(SimStats &stats, const Sm &game) {
+  const Game::QuestionDeck &deck = game.deck;
+  if (deck.count != game.level.questions) {
+    stats.deckErrors++;
+  }
+  byte rank = Game::headToHead ? simMatchGames[game.station]++ : SIM_MATCH_DECKS;
+  if (rank < simMatchDealt) { //another station has already played this game of the match
+    if (memcmp(simMatchDecks[rank].cards, deck.cards, sizeof(deck.cards)) != 0) {
+      stats.deckErrors++;
+    }
+  } else if (rank < SIM_MATCH_DECKS) {
+    simMatchDecks[simMatchDealt++] = deck;
+  }
+  if ((rank != 0) && (rank < SIM_MATCH_DECKS) && (memcmp(simMatchDecks[rank - 1].cards, deck.cards, sizeof(deck.cards)) == 0)) {
+    stats.deckErrors++; //the same questions as its last game
+  }
+  for (byte i = 0; i < deck.count; i++) {
+    const Game::Question &q = deck.cards[i];
+    int expected[] = {q.num1 + q.num2, q.num1 - q.num2, q.num1 * q.num2, (q.num2 != 0) ? (q.num1 / q.num2) : -1};
+    if ((q.answer != expected[q.op]) || ((q.op == 1) && (q.num2 > q.num1)) || ((q.op == 3) && (q.num1 % q.num2 != 0))) {
+      stats.deckErrors++;
+    }
+    for (byte j = 0; j < i; j++) {
+      if ((deck.cards[j].op == q.op) && (deck.cards[j].num1 == q.num1) && (deck.cards[j].num2 == q.num2)) {
+        stats.deckDuplicates++;
+      }
+    }
+  }
+}
+
+// Function used to check the event stream sent during a run: every frame whole and numbered in order, one answer event per question
+// typed, as many right answers as the total scores and one game end per game
+static void simCheckEvents(SimStats &stats) {
+  typedef Game::EventLog Log;
+  unsigned long frames = 0, answers = 0, correct = 0, ends = 0, errors = 0;
+  size_t i = 0;
+  while (i + Log::HEADER_SIZE <= simUartTx.size()) {
+    const byte *frame = &simUartTx[i];
+    size_t size = Log::HEADER_SIZE + frame[8] * Log::RECORD_SIZE + 1;
+    if ((frame[0] != Log::FRAME_MAGIC) || (frame[1] != Log::FRAME_TYPE) || (frame[2] != Log::FRAME_VERSION) ||
+        (i + size > simUartTx.size()) || (Game::crc8(frame, size - 1) != frame[size - 1])) {
+      errors++; //the stream only holds event frames, nothing may be skipped
+      i++;
+      continue;
+    }
+    if ((unsigned int)(frame[3] | (frame[4] << 8)) != Game::events.board) {
+      errors++;
+    }
+    if (((unsigned long)(frame[5] | (frame[6] << 8)) != (frames & 0xFFFF)) || (frame[7] != 0)) { //lost frames or records
+      errors++;
+    }
+    for (byte r = 0; r < frame[8]; r++) {
+      const byte *record = frame + Log::HEADER_SIZE + r * Log::RECORD_SIZE;
+      if (record[0] == Game::EVENT_ANSWER) {
+        answers++;
+        correct += (record[7] & 0x80) != 0;
+      } else if (record[0] == Game::EVENT_GAME_END) {
+        ends++;
+      }
+    }
+    frames++;
+    i += size;
+  }
+  unsigned long totals = 0;
+  for (byte p = 0; p < Game::SCORE_PROFILES; p++) {
+    totals += Game::scores.total(p);
+  }
+  printf("event stream     %zu bytes, %lu frames, %lu answers (%lu right), %lu games, %lu errors\n", simUartTx.size(), frames, answers,
+         correct, ends, errors);
+  if ((errors != 0) || (answers != stats.questions) || (correct != totals) || (ends != stats.games)) {
+    stats.mismatches++;
+  }
+}
+
+// Function used to set the IR sensor output (active low on PD1)
+static void simSetIr(bool detected) {
+  byte before = hostRegisters[0x29];
+  if (detected) {
+    hostRegisters[0x29] &= ~B00000010;
+  } else {
+    hostRegisters[0x29] |= B00000010;
+  }
+  if (hostRegisters[0x29] != before) { //the pin change interrupt wakes the board up
+    simAsleep = false;
+  }
+}
+
+// Function used to find the station of a keypad expander address, -1 if no expander answers there
+int simExpanderStation(byte address) {
+  int station = address - KEYPAD_EXPANDER_ADDRESS + 1;
+  return ((station >= 1) && (station < simStations)) ? station : -1;
+}
+
+// Function used when the game writes the pins of a keypad expander
+void simExpanderWrite(int station, byte value) {
+  simExpanderPins[station] = value;
+}
+
+// Function used to read the pins of a keypad expander: a column reads low if a key held down on it is on a row driven low
+byte simExpanderRead(int station) {
+  byte pins = simExpanderPins[station] | 0xF0; //the columns are pulled up
+  for (byte row = 0; row < ROWS; row++) {
+    if (simExpanderPins[station] & (1 << row)) { //the row is not driven low
+      continue;
+    }
+    for (byte col = 0; col < COLS; col++) {
+      if (simKeyDown[station][(byte)keys[row][col]]) {
+        pins &= ~(0x10 << col);
+      }
+    }
+  }
+  return pins;
+}
+
+// Function used to type a whole number followed by '#' on the keypad of a station
+static void simTypeAnswer(int value, byte station) {
+  char text[12];
+  Game::formatNumber(text, value);
+  for (char *c = text; *c; c++) {
+    simPressKey(*c, station);
+  }
+  simPressKey('#', station);
+}
+
+// Function used to get the time until the game has something to do, in microseconds
+static uint64_t simGameWait() {
+  unsigned long now = millis();
+  if (my_game.phaseLength != 0) { //the phase ends at a deadline
+    unsigned long passed = now - my_game.phaseStart;
+    return (passed >= my_game.phaseLength) ? 0 : (uint64_t)(my_game.phaseLength - passed) * 1000;
+  }
+  if (Game::pulses.playing) { //the next blink/buzz change
+    return (uint64_t)Game::pulses.ticksLeft * 500 - (simMicros % 500);
+  }
+  if (Game::pulses.finished) { //the callback is waiting for loop()
+    return 0;
+  }
+  if ((my_game.phase == Sm::PHASE_ANSWERING) && my_game.timer.running) { //the timer redraws every second
+    unsigned long passed = my_game.timer.elapsed();
+    unsigned long until = my_game.timer.nextChange;
+    return (passed >= until) ? 0 : (uint64_t)(until - passed) * 1000;
+  }
+  return UINT64_MAX; //waiting for the player
+}
+
+// Function used to get the time until the typist or the keypad scan has something to do, in microseconds
+static uint64_t simInputWait() {
+  uint64_t next = UINT64_MAX;
+  if (simTypist.head != simTypist.tail) { //a key is waiting to be pressed
+    next = (simTypist.nextPressAt > simMicros) ? simTypist.nextPressAt : simMicros;
+  }
+  bool tracking = false; //if the keypad still follows a key
+  for (byte i = 0; i < sizeof(simTypist.down); i++) {
+    if ((simTypist.down[i] != NO_KEY) && (simTypist.releaseAt[i] < next)) {
+      next = simTypist.releaseAt[i];
+    }
+  }
+  for (byte i = 0; i < LIST_MAX; i++) {
+    tracking |= (keypad.key[i].kchar != NO_KEY);
+  }
+  if (tracking || simTypistBusy()) { //the next scan of the keypad interrupt
+    uint64_t scan = (uint64_t)(keypad.startTime + keypad.debounceTime + 1) * 1000;
+    if (scan < next) {
+      next = scan;
+    }
+  }
+  if (next == UINT64_MAX) {
+    return UINT64_MAX;
+  }
+  return (next > simMicros) ? (next - simMicros) : 0;
+}
+
+// Function used to let the player of a station act on what its game displays
+static void simPlayerAct(SimPlayer &player, SimStats &stats, byte level, byte station = 0) {
+  Sm &game = stations.at[station].game;
+  switch (game.phase) {
+    case (Sm::PHASE_IDLE):
+      if (player.idleMs == 0) {
+        simSetIr(true); //wave at the sensor right away
+      } else if (player.actAt == 0) { //nobody comes for a while
+        player.actAt = simMicros + (uint64_t)player.idleMs * 1000;
+      } else if (simMicros >= player.actAt) {
+        player.actAt = 0;
+        stats.wakeBusBytes = simDisplay.busBytes; //LCD traffic until "Hello!" is displayed
+        stats.waking = simAsleep;
+        simSetIr(true); //wave at the sensor
+      }
+      break;
+    case (Sm::PHASE_LEVEL_SELECT):
+      simSetIr(false);
+      if (!simTypistBusy(station)) {
+        simPressKey('A' + (stats.games % Game::SCORE_PROFILES), station); //player profile
+        simPressKey('0' + level, station);
+        player.answered = 0;
+        player.totalBefore = Game::scores.total(stats.games % Game::SCORE_PROFILES);
+      }
+      break;
+    case (Sm::PHASE_ANSWERING):
+      if (simTypistBusy(station)) { //still typing the last answer
+        break;
+      }
+      if (player.actAt == 0) { //the question has just been displayed
+        if (game.deck.next == 1) { //first question of the game
+          simCheckDeck(stats, game);
+        }
+        player.actAt = simMicros + (uint64_t)player.thinkMs * 1000;
+      } else if (simMicros >= player.actAt) { //done thinking
+        player.actAt = 0;
+        if ((player.quitAt != 0) && (game.deck.next > player.quitAt)) { //had enough
+          stats.games++;
+          stats.exits++;
+          simPressKey('*', station);
+          break;
+        }
+        stats.questions++;
+        if (player.draw(100) < player.accuracy) {
+          simTypeAnswer(game.correctValue, station);
+          player.answered++;
+        } else {
+          simTypeAnswer(game.correctValue + 1, station);
+        }
+      }
+      break;
+    case (Sm::PHASE_FEEDBACK): //the last result is displayed
+    case (Sm::PHASE_SCORE): //the score of the game is displayed
+      if ((player.quitLate != 0) && (game.numQuestions == 0) && !simTypistBusy(station) &&
+          ((stats.games % player.quitLate) == ((game.phase == Sm::PHASE_FEEDBACK) ? 1 : 3))) { //leaves without waiting
+        if (game.score != player.answered) {
+          stats.mismatches++;
+        }
+        stats.games++;
+        stats.lateExits++;
+        player.checkTotal = true;
+        simPressKey('*', station);
+      }
+      break;
+    case (Sm::PHASE_GOODBYE):
+      if (player.checkTotal) { //the game stopped early must have kept its score
+        player.checkTotal = false;
+        if (Game::scores.total(game.profile) != player.totalBefore + player.answered) {
+          stats.lostScores++;
+          stats.mismatches++;
+        }
+      }
+      break;
+    case (Sm::PHASE_TOTAL):
+      if (!simTypistBusy(station)) {
+        if (game.score != player.answered) {
+          stats.mismatches++;
+        }
+        stats.games++;
+        simPressKey('*', station); //leave the game
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Longest loop() iteration allowed on the board, I2C bus time included: CELLS_PER_SLICE cells and a custom character
+const unsigned long SIM_WORST_LOOP_US = 10000;
+
+// Function used to run loop() with its I2C bus time on micros(), returns the length of the iteration: 50 us of code, then the bus
+static uint64_t simTimedLoop() {
+  simBusMark = simBusBytes;
+  simBusTimed = true;
+  loop();
+  simBusTimed = false;
+  return 50 + (uint64_t)(simBusBytes - simBusMark) * SIM_BUS_BYTE_US;
+}
+
+// Function used to run a number of games, the levels are played in turn
+static void simRun(unsigned long games, SimPlayer &player, SimStats &stats) {
+  unsigned long target = stats.games + games;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (stats.games < target) {
+    simPlayerAct(player, stats, 1 + (stats.games % Game::LEVEL_COUNT));
+    if (simAsleep) { //the board is halted until the IR sensor output changes
+      uint64_t sleep = (player.actAt > simMicros) ? (player.actAt - simMicros) : 1000;
+      stats.idleMicros += sleep;
+      simAdvance(sleep);
+      continue;
+    }
+    unsigned long allocations = simAllocations;
+    size_t txCapacity = simUartTx.capacity();
+    std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+    uint64_t cost = simTimedLoop(); //the next iteration cannot start before this one is over
+    if (stats.waking) { //first iteration after a wake-up, it displays "Hello!"
+      stats.waking = false;
+      stats.wakeUps++;
+      if (simDisplay.busBytes - stats.wakeBusBytes > stats.worstWakeBytes) {
+        stats.worstWakeBytes = simDisplay.busBytes - stats.wakeBusBytes;
+      }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - before).count();
+    if (ns > stats.worstLoopNs) {
+      stats.worstLoopNs = ns;
+    }
+    if (simUartTx.capacity() == txCapacity) { //loop() must not allocate, but the simulator may grow its buffer
+      stats.allocations += simAllocations - allocations;
+    }
+    stats.loops++;
+    uint64_t wait = simGameWait(); //jump to the next thing that happens
+    uint64_t input = simInputWait();
+    if (input < wait) {
+      wait = input;
+    }
+    if ((player.actAt > simMicros) && ((player.actAt - simMicros) < wait)) {
+      wait = player.actAt - simMicros;
+    }
+    if ((my_game.phase == Sm::PHASE_IDLE) || (keyQueue.head != keyQueue.tail)) { //the IR sensor or a key needs a loop
+      wait = 1000;
+    }
+    if (!my_game.lcd.flushed()) { //the next cells go in the next iteration
+      wait = 0;
+    }
+    uint64_t step = (wait == 0) ? 1 : ((wait == UINT64_MAX) ? 1000 : wait);
+    step = (step < cost) ? cost : step;
+    if (my_game.phase == Sm::PHASE_IDLE) { //awake while nobody plays
+      stats.idleMicros += step;
+    }
+    simAdvance(step);
+  }
+  stats.hostSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Stress test of the keypad: keys typed at 20 per second while loop() only runs every stallMs, every key must reach loop()
+static int simKeyStress(unsigned long presses, unsigned long stallMs, uint64_t holdUs) {
+  simTypist.periodUs = 50000; //20 keys per second
+  simTypist.holdUs = holdUs; //longer than the period: the next key is pressed before the last one is released
+  simSetIr(true); //start a game on the easy level
+  for (int i = 0; (i < 2000) && (my_game.phase != Sm::PHASE_LEVEL_SELECT); i++) {
+    loop();
+    simAdvance(1000);
+  }
+  simSetIr(false);
+  unsigned long pressedBefore = simTypist.pressed;
+  unsigned long handledBefore = keysHandled;
+  simPressKey('1');
+  worstKeyLatencyMicros = 0;
+  const char pattern[] = "2D3D4D5D6D7D8D9D0D1D"; //never the same key twice in a row, '#' and '*' would end the game
+  unsigned long queued = 0;
+  unsigned long sinceLoop = 0;
+  while ((queued < presses) || simTypistBusy() || (keyQueue.head != keyQueue.tail)) {
+    while ((queued < presses) && simPressKey(pattern[queued % (sizeof(pattern) - 1)])) {
+      queued++;
+    }
+    simAdvance(1000); //the interrupt scans the keypad every millisecond
+    if (++sinceLoop >= stallMs) { //loop() is blocked in between
+      loop();
+      sinceLoop = 0;
+    }
+  }
+  for (int i = 0; i < 20; i++) { //let the last keys through
+    simAdvance(1000);
+    loop();
+  }
+  unsigned long pressed = simTypist.pressed - pressedBefore;
+  unsigned long handled = keysHandled - handledBefore;
+  printf("keys pressed     %lu (every %lu ms, held %lu ms)\n", pressed, (unsigned long)(simTypist.periodUs / 1000),
+         (unsigned long)(holdUs / 1000));
+  printf("keys handled     %lu (loop() every %lu ms)\n", handled, stallMs);
+  printf("keys dropped     %lu (queue full %u)\n", pressed - handled, keyQueue.dropped);
+  printf("worst latency    %.1f ms\n", worstKeyLatencyMicros / 1000.0);
+  return (handled == pressed) ? 0 : 1;
+}
+
+// Function used to get the chi-square value above which a uniform histogram is rejected with a 0.1% risk (Wilson-Hilferty)
+static double simChiSquareLimit(unsigned int cells) {
+  double df = cells - 1;
+  double a = 2.0 / (9.0 * df);
+  double b = 1.0 - a + 3.090 * sqrt(a); //3.090: 99.9% quantile of the normal distribution
+  return df * b * b * b;
+}
+
+// Function used to test if the values [low, high) are equally frequent in a histogram, returns false if they are not
+static bool simUniform(const char *name, const unsigned long *counts, int low, int high) {
+  unsigned long total = 0;
+  for (int v = low; v < high; v++) {
+    total += counts[v];
+  }
+  double expected = (double)total / (high - low);
+  double chi = 0;
+  for (int v = low; v < high; v++) {
+    chi += (counts[v] - expected) * (counts[v] - expected) / expected;
+  }
+  double limit = simChiSquareLimit(high - low);
+  bool ok = chi < limit;
+  printf("%-22s %9lu draws %3d values  chi2 %7.1f < %6.1f  %s\n", name, total, high - low, chi, limit, ok ? "ok" : "NOT UNIFORM");
+  return ok;
+}
+
+// Function used to test if the second operands allowed with each first operand are equally frequent, in a histogram of the pairs.
+// allowed() tells if a pair can be drawn, a pair that cannot counts as a failure.
+static bool simUniformGiven(const char *name, unsigned long pairs[][128], int low, int high, bool (*allowed)(int, int, int)) {
+  unsigned long total = 0;
+  unsigned long wrong = 0;
+  unsigned int cells = 1; //degrees of freedom + 1, like a histogram of that many values
+  double chi = 0;
+  for (int first = low; first < high; first++) {
+    unsigned long drawn = 0;
+    unsigned int values = 0;
+    for (int second = 0; second < 128; second++) {
+      if (allowed(first, second, low)) {
+        drawn += pairs[first][second];
+        values++;
+      } else {
+        wrong += pairs[first][second];
+      }
+    }
+    total += drawn;
+    if ((drawn == 0) || (values < 2)) {
+      continue;
+    }
+    double expected = (double)drawn / values;
+    for (int second = 0; second < 128; second++) {
+      if (allowed(first, second, low)) {
+        chi += (pairs[first][second] - expected) * (pairs[first][second] - expected) / expected;
+      }
+    }
+    cells += values - 1;
+  }
+  double limit = simChiSquareLimit(cells);
+  bool ok = (chi < limit) && (wrong == 0);
+  printf("%-22s %9lu draws %3u values  chi2 %7.1f < %6.1f  %s\n", name, total, cells - 1, chi, limit,
+         (wrong != 0) ? "OUT OF RANGE" : (ok ? "ok" : "NOT UNIFORM"));
+  return ok;
+}
+
+// Function used to tell if a subtraction can be drawn: the second operand is in the range and at most the first one
+static bool simSubtrahend(int first, int second, int low) {
+  return (second >= low) && (second <= first);
+}
+
+// Function used to tell if a division can be drawn: the second operand is in the range and divides the first one
+static bool simDivisor(int first, int second, int low) {
+  return (second >= low) && (second <= first) && ((first % second) == 0);
+}
+
+// Function used to compare the divisor table built by the compiler with the divisors found by trying every number
+static bool simCheckDivisors() {
+  unsigned long wrong = 0;
+  unsigned int position = 0;
+  for (unsigned int n = 1; n <= DIVIDEND_MAX; n++) {
+    if (DIVISORS.start[n] != position) {
+      wrong++;
+    }
+    for (unsigned int d = 1; d <= n; d++) {
+      if ((n % d) == 0) {
+        if ((position >= DIVISOR_COUNT) || (DIVISORS.list[position] != d)) {
+          wrong++;
+        }
+        position++;
+      }
+    }
+  }
+  if ((DIVISORS.start[DIVIDEND_MAX + 1] != position) || (position != DIVISOR_COUNT)) {
+    wrong++;
+  }
+  printf("divisor table          %u divisors of 1 to %u, %lu differences with a brute-force search\n", DIVISOR_COUNT,
+         DIVIDEND_MAX, wrong);
+  return wrong == 0;
+}
+
+// Most numbers one question may take from the generator: 3 bounded draws that each redraw less than half the time, so a question
+// that needs more than 32 is a sign of a loop that is not bounded any more
+const unsigned int SIM_MOST_DRAWS = 32;
+
+// Speed of the generator and uniformity of the operands drawn for each level
+static int simPrng(unsigned long draws) {
+  Game::Random rng;
+  rng.seed(1);
+  const uint16_t ranges[] = {4, 99, 19, 9}; //operation, easy operands, easy multiplications, medium/hard operands
+  volatile unsigned long sink = 0; //keeps the draws from being optimized away
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < draws; i++) {
+    sink += rng.below(ranges[i & 3]);
+  }
+  double fast = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < draws; i++) {
+    sink += random(0, ranges[i & 3]);
+  }
+  double libc = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("Random::below()        %.1f M draws/s on this host\n", draws / fast / 1e6);
+  printf("avr-libc random()      %.1f M draws/s on this host (32-bit divisions, slow on the AVR only)\n", draws / libc / 1e6);
+
+  bool ok = true;
+  unsigned long counts[128];
+  const uint16_t sizes[] = {2, 3, 5, 7, 10, 99, 100, 128};
+  for (byte i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) { //raw bounded draws
+    memset(counts, 0, sizeof(counts));
+    for (unsigned long d = 0; d < draws / 8; d++) {
+      counts[rng.below(sizes[i])]++;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "below(%u)", sizes[i]);
+    ok &= simUniform(name, counts, 0, sizes[i]);
+  }
+  ok &= simCheckDivisors();
+  for (byte level = 0; level < Game::LEVEL_COUNT; level++) { //operands drawn by the game for each level
+    const Game::LevelDesc &desc = Game::LEVELS[level];
+    unsigned long ops[5] = {0};
+    unsigned long first[5][128];
+    unsigned long second[5][128];
+    static unsigned long differences[128][128]; //subtractions drawn, by operands
+    static unsigned long divisions[128][128];
+    memset(first, 0, sizeof(first));
+    memset(second, 0, sizeof(second));
+    memset(differences, 0, sizeof(differences));
+    memset(divisions, 0, sizeof(divisions));
+    std::vector<float> ns; //time taken by each question
+    ns.reserve(draws / 4);
+    unsigned int mostDraws = 0; //most numbers taken from the generator for one question
+    unsigned long allDraws = 0;
+    for (unsigned long d = 0; d < draws / 4; d++) {
+      uint32_t state = my_game.rng.state;
+      std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+      Game::LEVEL_TABLE.levels[level].generateNumbers(my_game);
+      ns.push_back(std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - before).count());
+      Game::Random replay; //steps the generator until it reaches the new state to count the numbers taken
+      replay.state = state;
+      unsigned int taken = 0;
+      while ((replay.state != my_game.rng.state) && (taken < 1000)) {
+        replay.next();
+        taken++;
+      }
+      mostDraws = std::max(mostDraws, taken);
+      allDraws += taken;
+      ops[my_game.op]++;
+      first[my_game.op][my_game.num1]++;
+      second[my_game.op][my_game.num2]++;
+      if (my_game.op == 2) {
+        differences[my_game.num1][my_game.num2]++;
+      } else if (my_game.op == 4) {
+        divisions[my_game.num1][my_game.num2]++;
+      }
+    }
+    std::sort(ns.begin(), ns.end());
+    char name[32];
+    char label[16];
+    snprintf(label, sizeof(label), "level %d-%c", level + 1, desc.letter);
+    snprintf(name, sizeof(name), "%s operations", label);
+    ok &= simUniform(name, ops, 1, 5);
+    snprintf(name, sizeof(name), "%s + first", label);
+    ok &= simUniform(name, first[1], desc.ranges[0].low, desc.ranges[0].high);
+    snprintf(name, sizeof(name), "%s + second", label);
+    ok &= simUniform(name, second[1], desc.ranges[0].low, desc.ranges[0].high);
+    snprintf(name, sizeof(name), "%s - first", label);
+    ok &= simUniform(name, first[2], desc.ranges[1].low, desc.ranges[1].high);
+    snprintf(name, sizeof(name), "%s x first", label);
+    ok &= simUniform(name, first[3], desc.ranges[2].low, desc.ranges[2].high);
+    snprintf(name, sizeof(name), "%s x second", label);
+    ok &= simUniform(name, second[3], desc.ranges[2].low, desc.ranges[2].high);
+    snprintf(name, sizeof(name), "%s / first", label);
+    ok &= simUniform(name, first[4], desc.ranges[3].low, desc.ranges[3].high);
+    snprintf(name, sizeof(name), "%s - second", label);
+    ok &= simUniformGiven(name, differences, desc.ranges[1].low, desc.ranges[1].high, simSubtrahend);
+    snprintf(name, sizeof(name), "%s / second", label);
+    ok &= simUniformGiven(name, divisions, desc.ranges[3].low, desc.ranges[3].high, simDivisor);
+    bool bounded = mostDraws <= SIM_MOST_DRAWS;
+    printf("%-22s %.2f draws per question, at most %u (limit %u), %.0f ns p50, %.0f ns p99.9, %.0f ns worst on this host  %s\n",
+           label, (double)allDraws / ns.size(), mostDraws, SIM_MOST_DRAWS, ns[ns.size() / 2], ns[ns.size() * 999 / 1000], ns.back(),
+           bounded ? "ok" : "TOO MANY DRAWS");
+    ok &= bounded;
+  }
+  return (ok && (sink != 1)) ? 0 : 1;
+}
+
+// Function used to get the brightness [0-255] of the RGB LED (red << 16 | green << 8 | blue) from the registers: green follows the
+// Timer2 compare output when it is connected, and a connected OC1B only clears blue since Timer1 runs in normal mode
+static unsigned long simLedColor() {
+  byte portB = hostRegisters[0x25];
+  byte green = (hostRegisters[0xB0] & 0x80) ? hostRegisters[0xB3] : ((portB & GreenPin::MASK) ? 255 : 0); //COM2A1, OCR2A
+  bool blue = !(hostRegisters[0x80] & 0x20) && (portB & BluePin::MASK); //COM1B1
+  return ((portB & RedPin::MASK) ? 0xFF0000UL : 0) | ((unsigned long)green << 8) | (blue ? 0xFF : 0);
+}
+
+// Speed of setColor() against the analogWrite() calls it replaced, both must light the LED the same way. Pin toggles are not timed:
+// on the host both are the same read-modify-write of plain memory, the gain is on the board (one out instead of lds lds ld eor st).
+static int simPins(unsigned long count) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < count; i++) {
+    analogWrite(12, 0); //red
+    analogWrite(11, (int)(i & 0xFF)); //green
+    analogWrite(10, 0); //blue
+  }
+  double core = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  startGreenPwm();
+  start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < count; i++) {
+    my_game.setColor(0, (byte)i, 0);
+  }
+  double direct = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("setColor()       %6.2f ns with analogWrite(), %6.2f ns with OCR2A and IoPin on this host (%.1fx)\n", core * 1e9 / count,
+         direct * 1e9 / count, core / direct);
+
+  unsigned long mismatches = 0;
+  for (int value = 0; value < 256; value++) { //every colour the game can ask for
+    memset(hostRegisters, 0, sizeof(hostRegisters));
+    analogWrite(12, value);
+    analogWrite(11, value);
+    analogWrite(10, value);
+    unsigned long before = simLedColor();
+    memset(hostRegisters, 0, sizeof(hostRegisters));
+    startGreenPwm();
+    my_game.setColor((byte)value, (byte)value, (byte)value);
+    mismatches += (simLedColor() != before);
+  }
+  printf("colour mismatches %lu\n", mismatches);
+  return (mismatches == 0) ? 0 : 1;
+}
+
+// Function used to play matches on several stations at once, each player typing on the keypad of its own station.
+// The virtual clock is charged with the I2C bus time of every loop() iteration like in the single-station run, which is what makes
+// the iterations long on the board, and every key press is followed until the game of its station handles it.
+static int simStationsRun(byte count, unsigned long matches, bool headToHead, unsigned long maxLatencyMs) {
+  simStations = count; //the LCDs and keypad expanders that answer on the bus
+  Game::headToHead = headToHead;
+  setup();
+  SimPlayer players[STATIONS];
+  unsigned long seen[STATIONS] = {0}; //key presses of each station already followed
+  uint64_t worstUs[STATIONS] = {0}; //longest time from a press to its handling
+  uint64_t totalUs[STATIONS] = {0};
+  for (byte i = 0; i < count; i++) {
+    players[i] = {(uint32_t)(i + 1), 90, 1000UL + 400UL * i, 0, 0, 0, 0, 0, 0, false}; //every player thinks at a different speed
+    simTypists[i].holdUs = 80000; //a brisk human typist: 6 keys per second, each held for 80 ms
+    simTypists[i].periodUs = 160000;
+  }
+  SimStats stats = {0, 0, 0, 0, 0.0, 0.0, 0, 0, 0, 0, 0, 0, false, 0, 0, 0, 0};
+  unsigned long match = 0;
+  uint64_t worstIterationUs = 0; //longest loop() iteration, bus time included
+  unsigned long clashes = 0; //iterations that left a tone on the speaker while it buzzes a question
+  byte quiet = 0; //iterations in a row without bus traffic
+  uint64_t start = simMicros;
+  std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+  while (true) {
+    if (stationsIdle() && !simTypistBusy(0)) { //the match is over on every station
+      if (match == matches) {
+        break;
+      }
+      match++;
+      simMatchDealt = 0;
+      memset(simMatchGames, 0, sizeof(simMatchGames));
+      simSetIr(true); //everybody waves for the next match
+    }
+    byte level = 1 + ((match - 1) % Game::LEVEL_COUNT); //the same level on every station
+    for (byte i = 0; i < count; i++) {
+      if (stations.at[i].game.phase != Sm::PHASE_IDLE) {
+        simPlayerAct(players[i], stats, level, i);
+      }
+    }
+    if ((count > 1) && (stations.at[0].game.phase == Sm::PHASE_IDLE) && !stationsIdle() && (simMatchGames[0] == 1)) {
+      simSetIr(true); //the fastest player plays the level again while the others finish, the stations that are done join in
+    }
+    if (simAsleep) {
+      simAdvance(1000);
+      continue;
+    }
+    unsigned long bus = simBusBytes;
+    uint64_t cost = simTimedLoop();
+    stats.loops++;
+    worstIterationUs = (cost > worstIterationUs) ? cost : worstIterationUs;
+    if (Game::pulses.playing && (Game::pulses.script.allOutputs() & SpeakerPin::MASK) && tonePlaying()) {
+      clashes++; //the player would not hear the buzzes apart
+    }
+    quiet = (simBusBytes == bus) ? (quiet + 1) : 0;
+    if (quiet >= count) { //a whole round without bus traffic: nothing changes before the next millisecond
+      cost = 1000 - (simMicros % 1000);
+    }
+    simAdvance(cost);
+    for (byte i = 0; i < count; i++) { //the keys handled by this iteration
+      while (seen[i] < stations.at[i].keysHandled) {
+        uint64_t latency = simMicros - simTypists[i].pressTimes[seen[i] % 64];
+        worstUs[i] = (latency > worstUs[i]) ? latency : worstUs[i];
+        totalUs[i] += latency;
+        seen[i]++;
+      }
+    }
+  }
+  double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hostStart).count();
+  printf("stations         %u, %s, %lu matches, %lu games, %lu questions\n", count, headToHead ? "head-to-head" : "independent decks",
+         matches, stats.games, stats.questions);
+  printf("virtual time     %.1f min (host time %.3f s)\n", (simMicros - start) / 6e7, hostSeconds);
+  printf("loop()           %.2f ms per iteration, worst %.1f ms (bus time included)\n", (simMicros - start) / 1e3 / stats.loops,
+         worstIterationUs / 1e3);
+  printf("speaker          %lu iterations with a tone over the buzzes of a question\n", clashes);
+  printf("station  keys  dropped  worst latency  mean latency  LCD bus bytes\n");
+  bool ok = (stats.mismatches == 0) && (stats.deckErrors == 0) && (clashes == 0);
+  for (byte i = 0; i < count; i++) {
+    unsigned long dropped = simTypists[i].pressed - stations.at[i].keysHandled;
+    printf("%7u %5lu %8lu %11.1f ms %10.1f ms %14lu\n", i, simTypists[i].pressed, dropped, worstUs[i] / 1e3,
+           seen[i] ? totalUs[i] / 1e3 / seen[i] : 0.0, simDisplays[i].busBytes);
+    ok &= (dropped == 0) && (worstUs[i] <= maxLatencyMs * 1000);
+  }
+  printf("score mismatches %lu, deck errors %lu, latency limit %lu ms: %s\n", stats.mismatches, stats.deckErrors, maxLatencyMs,
+         ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+// Result of the benchmark. The counts come from the virtual board and are the same on every host, so they are compared with the
+// stored baseline. The timings depend on the host and are only reported.
+struct SimMetric {
+  const char *name; //key in the JSON files
+  double value; //measured value
+  double tolerance; //allowed change from the baseline in the bad direction as a fraction, or SIM_EXACT or SIM_REPORT
+  bool higherIsBetter; //if a higher value is an improvement
+};
+const double SIM_EXACT = -1; //the value must match the baseline: the workload or the outcome of the games changed
+const double SIM_REPORT = -2; //host timing, printed next to the baseline but never a regression
+const double SIM_COUNT = 1e-6; //the value must not get worse, beyond the rounding of the JSON file
+
+// Function used to find a metric in a flat JSON object, returns false if it is not there
+static bool simJsonValue(const std::string &json, const char *name, double &value) {
+  std::string key = std::string("\"") + name + "\":";
+  size_t at = json.find(key);
+  return (at != std::string::npos) && (sscanf(json.c_str() + at + key.size(), "%lf", &value) == 1);
+}
+
+// Benchmark of the game loop: games on every level with fast, average and slow players, one game in five left early with '*'.
+// Results are printed, written as JSON and compared with a baseline written by an earlier run, the exit code is 1 on a regression.
+static int simBench(const char *resultsPath, const char *baselinePath) {
+  const unsigned long GAMES = 400;
+  const unsigned long THINK_MS[3] = {400, 1500, 6000}; //time to answer of each kind of player
+  const uint64_t HOLD_US[3] = {30000, 80000, 150000}; //time a key is held
+  const uint64_t PERIOD_US[3] = {60000, 160000, 400000}; //time between two keys
+  setup();
+  simUartTx.reserve(1 << 24); //the events sent during the run fit, so the heap is checked around every loop()
+  SimPlayer player = {7, 85, 0, 5000, 0, 0, 0, 0, 0, false};
+  SimStats stats = {0, 0, 0, 0, 0.0, 0.0, 0, 0, 0, 0, 0, 0, false, 0, 0, 0, 0};
+  unsigned long eepromStart = EEPROM.writes;
+  while (stats.games < GAMES) {
+    unsigned long game = stats.games;
+    byte kind = (game / Game::LEVEL_COUNT) % 3; //every level with every kind of player
+    player.thinkMs = THINK_MS[kind];
+    player.quitAt = ((game % 5) == 4) ? (1 + game % 7) : 0;
+    simTypist.holdUs = HOLD_US[kind];
+    simTypist.periodUs = PERIOD_US[kind];
+    simRun(1, player, stats);
+  }
+  for (int i = 0; i < 20; i++) { //let the last record reach the EEPROM
+    loop();
+    simAdvance(1000);
+  }
+  unsigned long eepromBytes = EEPROM.writes - eepromStart;
+  uint32_t outcome = Game::events.outcome; //hash of every question, answer and game end
+
+  std::vector<double> deckNs; //time to draw the deck of a game, per question
+  for (byte level = 0; level < Game::LEVEL_COUNT; level++) {
+    for (int i = 0; i < 5000; i++) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      Game::LEVEL_TABLE.levels[level].buildDeck(my_game);
+      double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      deckNs.push_back(ns / my_game.deck.count);
+    }
+  }
+  std::sort(deckNs.begin(), deckNs.end());
+
+  SimMetric metrics[] = {
+    {"games", (double)stats.games, SIM_EXACT, true},
+    {"early_exits", (double)stats.exits, SIM_EXACT, true},
+    {"questions", (double)stats.questions, SIM_EXACT, true},
+    {"outcome_hash", (double)outcome, SIM_EXACT, true},
+    {"loops", (double)stats.loops, SIM_EXACT, true},
+    {"i2c_bytes_per_question", (double)simDisplay.busBytes / stats.questions, SIM_COUNT, false},
+    {"lcd_commands_per_question", (double)simDisplay.commands / stats.questions, SIM_COUNT, false},
+    {"lcd_characters_per_question", (double)simDisplay.dataWrites / stats.questions, SIM_COUNT, false},
+    {"eeprom_bytes_per_game", (double)eepromBytes / stats.games, SIM_COUNT, false},
+    {"heap_allocations", (double)stats.allocations, SIM_COUNT, false},
+    {"worst_loop_us", (double)Game::profiler.figures[Game::FIGURE_WORST_LOOP_US], SIM_COUNT, false},
+    {"host_loops_per_second", stats.loops / stats.hostSeconds, SIM_REPORT, true},
+    {"host_questions_per_second", stats.questions / stats.hostSeconds, SIM_REPORT, true},
+    {"host_deck_ns_per_question_p50", deckNs[deckNs.size() / 2], SIM_REPORT, false},
+    {"host_deck_ns_per_question_p90", deckNs[deckNs.size() * 9 / 10], SIM_REPORT, false},
+    {"host_deck_ns_per_question_p99", deckNs[deckNs.size() * 99 / 100], SIM_REPORT, false},
+  };
+  const size_t count = sizeof(metrics) / sizeof(metrics[0]);
+
+  std::string baseline;
+  if (baselinePath != 0) {
+    FILE *file = fopen(baselinePath, "rb");
+    if (file == 0) {
+      fprintf(stderr, "cannot open %s\n", baselinePath);
+      return 2;
+    }
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      baseline.append(buffer, got);
+    }
+    fclose(file);
+  }
+  printf("%-30s %14s %14s %8s\n", "metric", "value", "baseline", "change");
+  unsigned long regressions = 0;
+  for (size_t i = 0; i < count; i++) {
+    const SimMetric &metric = metrics[i];
+    double before;
+    if (!simJsonValue(baseline, metric.name, before)) {
+      printf("%-30s %14.2f %14s\n", metric.name, metric.value, "-");
+      continue;
+    }
+    double change = (before != 0) ? (metric.value - before) / before : ((metric.value != 0) ? 1.0 : 0.0);
+    double worse = metric.higherIsBetter ? -change : change; //how much worse, negative if better
+    bool bad = (metric.tolerance == SIM_EXACT) ? (metric.value != before) :
+               ((metric.tolerance != SIM_REPORT) && (worse > metric.tolerance));
+    printf("%-30s %14.2f %14.2f %+7.1f%% %s\n", metric.name, metric.value, before, change * 100,
+           bad ? "REGRESSION" : ((metric.tolerance == SIM_REPORT) ? "(host, not compared)" : ""));
+    regressions += bad;
+  }
+  printf("host time        %.3f s, virtual time %.1f h\n", stats.hostSeconds, simMicros / 3.6e9);
+  printf("score mismatches %lu, deck errors %lu, regressions %lu\n", stats.mismatches, stats.deckErrors, regressions);
+
+  if (resultsPath != 0) {
+    FILE *file = fopen(resultsPath, "wb");
+    if (file == 0) {
+      fprintf(stderr, "cannot write %s\n", resultsPath);
+      return 2;
+    }
+    fprintf(file, "{\n");
+    for (size_t i = 0; i < count; i++) {
+      fprintf(file, "  \"%s\": %.10g%s\n", metrics[i].name, metrics[i].value, (i + 1 < count) ? "," : "");
+    }
+    fprintf(file, "}\n");
+    fclose(file);
+  }
+  return ((regressions == 0) && (stats.mismatches == 0) && (stats.deckErrors == 0)) ? 0 : 1;
+}
+
+// Function used to read a session file of host/session.cpp: the session, its end entry, then the outcome
+static bool simReadSession(const char *path, std::vector<byte> &bytes, uint32_t &outcome) {
+  FILE *file = fopen(path, "rb");
+  if (file == 0) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    bytes.push_back((byte)c);
+  }
+  fclose(file);
+  if (bytes.size() < Game::SessionLog::HEADER_SIZE + 4) {
+    fprintf(stderr, "%s is not a session\n", path);
+    return false;
+  }
+  outcome = 0;
+  for (byte i = 0; i < 4; i++) {
+    outcome |= (uint32_t)bytes[bytes.size() - 4 + i] << (8 * i);
+  }
+  bytes.resize(bytes.size() - 4);
+  return true;
+}
+
+// Function used to replay session files like ./session play does on a board, the replayed outcome must be the recorded one
+static int simReplay(int count, char **paths) {
+  typedef Game::SessionLog Log;
+  std::vector<byte> first;
+  uint32_t outcome;
+  if (!simReadSession(paths[0], first, outcome)) {
+    return 2;
+  }
+  simStations = first[1]; //the boards wired like the recording one
+  setup();
+  while (simMicros < 2000000) { //./session play waits 2 s for the board to start
+    loop();
+    simAdvance(1000);
+  }
+  simUartTx.clear();
+  int failed = 0;
+  for (int f = 0; f < count; f++) {
+    std::vector<byte> bytes;
+    if (!simReadSession(paths[f], bytes, outcome)) {
+      return 2;
+    }
+    size_t sent = 0;
+    size_t cursor = simUartTx.size(); //bytes sent by the board already read
+    simUartRx.push_back(0xFF); //the wake byte, then the replay command
+    simUartRx.push_back('L');
+    simAsleep = false; //RX wakes the board
+    uint64_t start = simMicros;
+    unsigned long loops = 0;
+    std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+    const byte *done = 0;
+    while (done == 0) {
+      loop();
+      loops++;
+      while ((done == 0) && (cursor + 4 <= simUartTx.size())) { //the frames sent by the board, event frames take several loop()
+        const byte *frame = &simUartTx[cursor];
+        size_t left = simUartTx.size() - cursor;
+        if (frame[1] == Game::EventLog::FRAME_TYPE) {
+          if ((left < Game::EventLog::HEADER_SIZE) ||
+              (left < Game::EventLog::HEADER_SIZE + (size_t)frame[8] * Game::EventLog::RECORD_SIZE + 1)) {
+            break; //wait for the rest
+          }
+          cursor += Game::EventLog::HEADER_SIZE + frame[8] * Game::EventLog::RECORD_SIZE + 1;
+        } else if (frame[1] == 'N') { //the board asks for a chunk
+          size_t length = bytes.size() - sent;
+          length = (length > (size_t)frame[2]) ? frame[2] : length;
+          byte chunk[258];
+          chunk[0] = (byte)length;
+          memcpy(chunk + 1, &bytes[sent], length);
+          chunk[length + 1] = Game::crc8(chunk, length + 1);
+          simUartRx.insert(simUartRx.end(), chunk, chunk + length + 2);
+          sent += length;
+          cursor += 4;
+        } else if (frame[1] == 'D') {
+          if (left < Log::DONE_SIZE) {
+            break;
+          }
+          done = frame;
+        } else {
+          cursor++;
+        }
+      }
+      uint64_t wait = simGameWait();
+      if (!simUartRx.empty() || (Game::session.replaying && !Game::session.haveNext && (Game::session.available() != 0))) {
+        wait = 1; //bytes to take or to parse
+      } else if (Game::session.haveNext) { //the next input is known, jump to it
+        uint64_t at = (uint64_t)(Game::session.origin + Game::session.nextAt) * 1000;
+        uint64_t until = (at > simMicros) ? (at - simMicros) : 0;
+        wait = (until < wait) ? until : wait;
+      }
+      if ((stationCount > 1) && (wait > 1000)) { //the other stations need their slices
+        wait = 1000;
+      }
+      simAdvance((wait == 0) ? 1 : ((wait == UINT64_MAX) ? 1000 : wait));
+    }
+    double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hostStart).count();
+    uint32_t replayed = 0;
+    for (byte i = 0; i < 4; i++) {
+      replayed |= (uint32_t)done[4 + i] << (8 * i);
+    }
+    bool ok = (done[3] == Log::REPLAY_OK) && (replayed == outcome);
+    printf("%s: status %u, %u inputs, %lu loop() calls, virtual time %.1f s, host time %.3f s (%.0fx), outcome %08x %s %08x\n",
+           paths[f], done[3], done[8] | (done[9] << 8), loops, (simMicros - start) / 1e6, hostSeconds,
+           (simMicros - start) / 1e6 / hostSeconds, replayed, (replayed == outcome) ? "==" : "!=", outcome);
+    uint64_t ended = simMicros;
+    while (!Game::session.recording && (simMicros - ended < 1000000)) { //the board records again once nobody plays
+      loop();
+      simAdvance(1000);
+    }
+    if (!Game::session.recording) {
+      printf("%s: the recording did not restart after the replay\n", paths[f]);
+      ok = false;
+    }
+    failed += !ok;
+  }
+  return (failed == 0) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  simSetIr(false);
+  for (byte i = 0; i < STATIONS; i++) { //20 keys per second, each held for 25 ms
+    simTypists[i].holdUs = 25000;
+    simTypists[i].periodUs = 50000;
+  }
+  if ((argc > 1) && (strcmp(argv[1], "stations") == 0)) { //several stations on one board
+    unsigned long count = (argc > 2) ? strtoul(argv[2], 0, 10) : 4;
+    unsigned long matches = (argc > 3) ? strtoul(argv[3], 0, 10) : 8;
+    if ((count < 1) || (count > STATIONS)) {
+      fprintf(stderr, "1 to %d stations\n", STATIONS);
+      return 2;
+    }
+    return simStationsRun((byte)count, matches, (argc <= 4) || (strcmp(argv[4], "independent") != 0), 100);
+  }
+  if ((argc > 1) && (strcmp(argv[1], "bench") == 0)) { //benchmark of the game loop
+    return simBench((argc > 2) ? argv[2] : 0, (argc > 3) ? argv[3] : 0);
+  }
+  if ((argc > 2) && (strcmp(argv[1], "replay") == 0)) { //recorded sessions
+    return simReplay(argc - 2, argv + 2);
+  }
+  if ((argc > 1) && (strcmp(argv[1], "keys") == 0)) { //keypad stress test
+    setup();
+    unsigned long presses = (argc > 2) ? strtoul(argv[2], 0, 10) : 2000;
+    unsigned long stallMs = (argc > 3) ? strtoul(argv[3], 0, 10) : 40;
+    return simKeyStress(presses, stallMs, 70000);
+  }
+  if ((argc > 1) && (strcmp(argv[1], "pins") == 0)) { //speed of the pin layer
+    setup();
+    return simPins((argc > 2) ? strtoul(argv[2], 0, 10) : 20000000);
+  }
+  if ((argc > 1) && (strcmp(argv[1], "prng") == 0)) { //speed and uniformity of the random numbers
+    setup();
+    return simPrng((argc > 2) ? strtoul(argv[2], 0, 10) : 4000000);
+  }
+  unsigned long games = (argc > 1) ? strtoul(argv[1], 0, 10) : 10000;
+  unsigned long seed = (argc > 2) ? strtoul(argv[2], 0, 10) : 1;
+  simAnalog[0] = (int)(seed & 0x3FF); //the potentiometer, gatherSeed() mixes it into the seed of the games
+  setup();
+
+  SimPlayer player = {(uint32_t)seed, 90, 1500, 60000, 0, 0, 0, 5, 0, false}; //nobody plays for a minute between two games,
+                                                                              //two games in five are left early once they end
+  SimStats stats = {0, 0, 0, 0, 0.0, 0.0, 0, 0, 0, 0, 0, 0, false, 0, 0, 0, 0};
+  unsigned long setupBytes = simDisplay.busBytes - my_game.lcd.i2cBytes; //lcd.init() goes around the count of the board
+  simRun(games, player, stats);
+
+  printf("games            %lu\n", stats.games);
+  printf("questions        %lu\n", stats.questions);
+  printf("loop() calls     %lu\n", stats.loops);
+  printf("virtual time     %.1f h\n", simMicros / 3.6e9);
+  printf("host time        %.3f s\n", stats.hostSeconds);
+  printf("questions/s      %.0f\n", stats.questions / stats.hostSeconds);
+  printf("loop() calls/s   %.0f\n", stats.loops / stats.hostSeconds);
+  printf("mean loop()      %.0f ns\n", stats.hostSeconds * 1e9 / stats.loops);
+  printf("worst loop()     %.0f ns on this host, %.1f ms on the board with the I2C bus (limit %.0f ms)\n", stats.worstLoopNs,
+         Game::profiler.figures[Game::FIGURE_WORST_LOOP_US] / 1e3, SIM_WORST_LOOP_US / 1e3);
+  if (Game::profiler.figures[Game::FIGURE_WORST_LOOP_US] > SIM_WORST_LOOP_US) {
+    stats.mismatches++; //an iteration holds the keys and the other stations too long
+  }
+  printf("LCD I2C bytes    %lu (%.1f per question)\n", simDisplay.busBytes, (double)simDisplay.busBytes / stats.questions);
+  const unsigned long *figures = Game::profiler.figures; //what the board reports in the profiler frame
+  printf("board I2C count  %lu bytes, %.1f per question from its display to its result, at most %lu\n", my_game.lcd.i2cBytes,
+         figures[Game::FIGURE_QUESTIONS] ? (double)figures[Game::FIGURE_QUESTION_I2C_BYTES] / figures[Game::FIGURE_QUESTIONS] : 0.0,
+         figures[Game::FIGURE_QUESTION_I2C_MOST]);
+  if (my_game.lcd.i2cBytes + setupBytes != simDisplay.busBytes) {
+    stats.mismatches++; //the board must count what reaches the bus
+  }
+
+  for (int i = 0; i < 20; i++) { //let the last record reach the EEPROM
+    loop();
+    simAdvance(1000);
+  }
+  Game::ScoreStore reloaded; //what the board would find after a reset
+  reloaded.begin();
+  unsigned long worstCell = 0;
+  for (unsigned int i = 0; i < EEPROM.length(); i++) {
+    if (EEPROM.cellWrites[i] > worstCell) {
+      worstCell = EEPROM.cellWrites[i];
+    }
+  }
+  for (byte p = 0; p < Game::SCORE_PROFILES; p++) {
+    if (reloaded.total(p) != Game::scores.total(p)) {
+      stats.mismatches++;
+    }
+  }
+  printf("score records    %lu\n", Game::scores.writes);
+  printf("EEPROM writes    %lu bytes, worst cell %lu (%.0fx fewer than one fixed cell)\n", EEPROM.writes, worstCell,
+         worstCell ? (double)Game::scores.writes / worstCell : 0.0);
+  printf("left at the end  %lu games with '*' on the last result or the score, %lu scores lost\n", stats.lateExits, stats.lostScores);
+  printf("heap allocations %lu by loop() after setup()\n", stats.allocations);
+  if (stats.allocations != 0) {
+    stats.mismatches++; //the game must only use static memory
+  }
+  printf("score mismatches %lu\n", stats.mismatches);
+  double idleHours = stats.idleMicros / 3.6e9;
+  double activeMs = (stats.idleMicros - simSleepMicros) / 1e3 + stats.wakeUps * 1.024; //awake in idle, plus 16K clock cycles of
+  double activeShare = idleHours ? (activeMs / 3.6e6 / idleHours) : 1.0;                //oscillator start-up per wake-up
+  double wakeMs = 1.024 + stats.worstWakeBytes * 0.09; //oscillator start-up, then 9 bits per LCD byte at 100 kHz
+  printf("idle time        %.1f h, %lu sleeps, %lu wake-ups\n", idleHours, sleepCount, stats.wakeUps);
+  printf("per idle hour    %.1f ms active, %.3f s asleep, about %.4f mAh instead of 10 mAh (10 mA active, 0.3 uA asleep)\n",
+         activeShare * 3.6e6, (1 - activeShare) * 3600, activeShare * 10.0 + (1 - activeShare) * 0.0003);
+  printf("wake to Hello!   about %.1f ms (oscillator start-up and %lu LCD bus bytes)\n", wakeMs, stats.worstWakeBytes);
+  if ((stats.wakeUps != 0) && (wakeMs >= 50.0)) {
+    stats.mismatches++; //too slow to greet the player
+  }
+  printf("question deck    %zu bytes of SRAM (%zu per question), %lu duplicates, %lu wrong answers\n",
+         sizeof(my_game.deck.cards), sizeof(Game::Question), stats.deckDuplicates, stats.deckErrors);
+  if ((sizeof(my_game.deck.cards) != Game::QuestionDeck::SIZE * 4) || (stats.deckErrors != 0)) {
+    stats.mismatches++; //the deck is larger than planned or wrong
+  }
+
+  simCheckEvents(stats);
+  if (argc > 4) { //save the events for host/leaderboard.cpp
+    FILE *file = fopen(argv[4], "wb");
+    if ((file == 0) || (fwrite(simUartTx.data(), 1, simUartTx.size(), file) != simUartTx.size())) {
+      fprintf(stderr, "cannot write %s\n", argv[4]);
+      return 2;
+    }
+    fclose(file);
+    printf("events           %zu bytes written to %s\n", simUartTx.size(), argv[4]);
+  }
+  simUartTx.clear(); //the profile file only holds the profile
+
+  if (argc > 3) { //ask for the profile like the decoder does on the board, and save it
+    simUartRx.push_back('P');
+    loop();
+    FILE *file = fopen(argv[3], "wb");
+    if ((file == 0) || (fwrite(simUartTx.data(), 1, simUartTx.size(), file) != simUartTx.size())) {
+      fprintf(stderr, "cannot write %s\n", argv[3]);
+      return 2;
+    }
+    fclose(file);
+    printf("profile          %zu bytes written to %s\n", simUartTx.size(), argv[3]);
+  }
+  return (stats.mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,702 @@
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/*                                                    SpeedMath Game - Linux simulator                                                        */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+/* In-memory replacements for the parts of the Arduino core and libraries used by code.c, so the game logic can run unchanged on Linux.      */
+/* The clock is virtual: it only moves when the simulator advances it, so hours of play take milliseconds.                                    */
+/* The LCD is emulated at the HD44780 level: both the LCD library calls and the raw I2C transfers of LcdBuffer update the same display.      */
+/* Each station has its own display and keys: the I2C bus routes every transfer to the LCD or keypad expander at its address.                 */
+/* ------------------------------------------------------------------------------------------------------------------------------------------ */
+
+#ifndef SPEEDMATH_SIMULATOR_H
+#define SPEEDMATH_SIMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+typedef uint8_t byte;
+
+// The game is built for 8 stations, simStations of them are wired to the simulated board
+#ifndef STATIONS
+#define STATIONS 8
+#endif
+
+// Binary constants used by the sketch (from the Arduino core binary.h)
+#define B00000 0
+#define B01010 10
+#define B01110 14
+#define B10001 17
+#define B11111 31
+#define B00000010 2
+#define B00000100 4
+#define B00001111 15
+#define B00100000 32
+#define B00111100 60
+
+#define LOW 0
+#define HIGH 1
+#define A0 14
+#define PROGMEM
+
+// Flash reads, the host keeps constants in normal memory (little-endian like the AVR)
+inline uint8_t pgm_read_byte(const void *address) {
+  return *(const uint8_t *)address;
+}
+
+inline uint16_t pgm_read_word(const void *address) {
+  uint16_t value;
+  memcpy(&value, address, sizeof(value));
+  return value;
+}
+
+inline void *memcpy_P(void *destination, const void *source, size_t size) {
+  return memcpy(destination, source, size);
+}
+
+// Virtual clock, in microseconds since power-up
+extern uint64_t simMicros;
+
+// unsigned long is 64-bit on Linux, so the clock does not wrap after 49 days like on the board
+inline unsigned long millis() {
+  return (unsigned long)(simMicros / 1000);
+}
+
+// I2C bus time of the loop() iteration being run, added to micros() so the board measures its iterations as it would with a blocking
+// bus (9 bits per byte at 100 kHz); the simulator moves the clock once the iteration is over, millis() only sees it then
+const unsigned int SIM_BUS_BYTE_US = 90;
+extern unsigned long simBusBytes; //bytes on the I2C bus for every device (including addresses)
+extern unsigned long simBusMark; //simBusBytes when the iteration started
+extern bool simBusTimed; //if an iteration is being run
+
+inline unsigned long micros() {
+  return (unsigned long)simMicros + (simBusTimed ? (simBusBytes - simBusMark) * SIM_BUS_BYTE_US : 0);
+}
+
+// Function used by the simulator to move the virtual clock forward
+inline void simAdvance(uint64_t us);
+
+// I/O registers of the ATmega328P data space (PIND, PORTD, DDRB, PORTB, ...)
+extern byte hostRegisters[0x100];
+
+// Speaker and PWM outputs
+extern unsigned int simToneFrequency; //frequency of the current tone, 0 if silent
+extern uint64_t simToneEnd; //time the current tone stops, 0 if it does not stop by itself
+extern unsigned long simToneCount; //number of tones started
+extern int simAnalog[8]; //values returned by analogRead()
+
+inline void tone(byte, unsigned int frequency, unsigned long duration = 0) {
+  simToneFrequency = frequency;
+  simToneEnd = (duration != 0) ? (simMicros + duration * 1000) : 0;
+  simToneCount++;
+}
+
+inline void noTone(byte) {
+  simToneFrequency = 0;
+  simToneEnd = 0;
+}
+
+// Arduino core pin functions of the Uno, with the same table lookups and register accesses as wiring_digital.c and wiring_analog.c,
+// so ./speedmath_sim pins can time them against the pin layer of code.c. The game itself does not use them.
+enum SimPinTimer : byte { SIM_NOT_ON_TIMER, SIM_TIMER0A, SIM_TIMER0B, SIM_TIMER1A, SIM_TIMER1B, SIM_TIMER2A, SIM_TIMER2B };
+const byte simPinPort[14] PROGMEM = {0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x23, 0x23, 0x23, 0x23, 0x23, 0x23}; //PINx
+const byte simPinMask[14] PROGMEM = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32};
+const byte simPinTimer[14] PROGMEM = {SIM_NOT_ON_TIMER, SIM_NOT_ON_TIMER, SIM_NOT_ON_TIMER, SIM_TIMER2B, SIM_NOT_ON_TIMER, SIM_TIMER0B,
+                                      SIM_TIMER0A, SIM_NOT_ON_TIMER, SIM_NOT_ON_TIMER, SIM_TIMER1A, SIM_TIMER1B, SIM_TIMER2A,
+                                      SIM_NOT_ON_TIMER, SIM_NOT_ON_TIMER};
+const byte simTimerControl[7] PROGMEM = {0, 0x44, 0x44, 0x80, 0x80, 0xB0, 0xB0}; //TCCRxA of each timer output
+const byte simTimerCompare[7] PROGMEM = {0, 0x47, 0x48, 0x88, 0x8A, 0xB3, 0xB4}; //OCRxy (low byte)
+const byte simTimerConnect[7] PROGMEM = {0, 0x80, 0x20, 0x80, 0x20, 0x80, 0x20}; //COMxy1 bit of TCCRxA
+#define OUTPUT 1
+
+inline void simTurnOffPwm(byte timer) {
+  volatile byte *control = &hostRegisters[pgm_read_byte(&simTimerControl[timer])];
+  *control &= ~pgm_read_byte(&simTimerConnect[timer]);
+}
+
+inline void pinMode(byte pin, byte mode) {
+  byte mask = pgm_read_byte(&simPinMask[pin]);
+  volatile byte *direction = &hostRegisters[pgm_read_byte(&simPinPort[pin]) + 1];
+  volatile byte *output = &hostRegisters[pgm_read_byte(&simPinPort[pin]) + 2];
+  byte sreg = hostRegisters[0x5F]; //SREG, the core turns the interrupts off around the read-modify-write
+  if (mode == OUTPUT) {
+    *direction |= mask;
+  } else {
+    *direction &= ~mask;
+    *output &= ~mask;
+  }
+  hostRegisters[0x5F] = sreg;
+}
+
+inline void digitalWrite(byte pin, byte value) {
+  byte timer = pgm_read_byte(&simPinTimer[pin]);
+  byte mask = pgm_read_byte(&simPinMask[pin]);
+  if (timer != SIM_NOT_ON_TIMER) {
+    simTurnOffPwm(timer);
+  }
+  volatile byte *output = &hostRegisters[pgm_read_byte(&simPinPort[pin]) + 2];
+  byte sreg = hostRegisters[0x5F];
+  if (value == LOW) {
+    *output &= ~mask;
+  } else {
+    *output |= mask;
+  }
+  hostRegisters[0x5F] = sreg;
+}
+
+inline void analogWrite(byte pin, int value) {
+  pinMode(pin, OUTPUT);
+  if (value == 0) {
+    digitalWrite(pin, LOW);
+  } else if (value == 255) {
+    digitalWrite(pin, HIGH);
+  } else {
+    byte timer = pgm_read_byte(&simPinTimer[pin]);
+    if (timer == SIM_NOT_ON_TIMER) {
+      digitalWrite(pin, (value < 128) ? LOW : HIGH);
+    } else {
+      hostRegisters[pgm_read_byte(&simTimerControl[timer])] |= pgm_read_byte(&simTimerConnect[timer]);
+      *(volatile byte *)&hostRegisters[pgm_read_byte(&simTimerCompare[timer])] = (byte)value;
+    }
+  }
+}
+
+inline int analogRead(byte pin) {
+  return simAnalog[(pin >= A0) ? (pin - A0) : pin];
+}
+
+// Random numbers, same generator as avr-libc random() so a seed gives the same questions as on the board
+extern uint32_t simRandomState;
+
+inline long random(long howBig) {
+  if (howBig == 0) {
+    return 0;
+  }
+  int32_t x = (int32_t)simRandomState;
+  if (x == 0) {
+    x = 123459876L;
+  }
+  int32_t hi = x / 127773L;
+  int32_t lo = x % 127773L;
+  x = 16807L * lo - 2836L * hi;
+  if (x < 0) {
+    x += 0x7fffffffL;
+  }
+  simRandomState = (uint32_t)x;
+  return (long)((uint32_t)x % 0x80000000UL) % howBig;
+}
+
+inline long random(long howSmall, long howBig) {
+  if (howSmall >= howBig) {
+    return howSmall;
+  }
+  return random(howBig - howSmall) + howSmall;
+}
+
+inline void randomSeed(unsigned long seed) {
+  if (seed != 0) {
+    simRandomState = (uint32_t)seed;
+  }
+}
+
+// Minimal Print class, enough for the LCD classes
+// Strings kept in flash with F(), the host keeps them in normal memory
+class __FlashStringHelper;
+#define F(text) (reinterpret_cast<const __FlashStringHelper *>(text))
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    size_t write(const char *text) {
+      size_t n = 0;
+      while (*text) {
+        n += write((uint8_t)*text++);
+      }
+      return n;
+    }
+    size_t print(const char *text) {
+      return write(text);
+    }
+    size_t print(const __FlashStringHelper *text) {
+      const char *p = reinterpret_cast<const char *>(text);
+      size_t n = 0;
+      while (pgm_read_byte(p) != 0) {
+        n += write(pgm_read_byte(p++));
+      }
+      return n;
+    }
+};
+
+// HD44780 display driven through a PCF8574 backpack
+struct SimDisplay {
+  char ddram[0x80]; //display memory, row 1 at 0x00 and row 2 at 0x40
+  byte cgram[64]; //custom characters
+  byte address; //address counter
+  bool cgramMode; //if the address counter points to the CGRAM
+  bool backlight; //state of the backlight
+  byte nibble; //upper 4 bits waiting for the lower ones
+  bool haveNibble; //if an upper nibble has been received
+  byte lastPins; //last value written to the PCF8574
+  unsigned long busBytes; //bytes on the I2C bus (including addresses)
+  unsigned long transactions; //I2C transactions
+  unsigned long commands; //HD44780 commands executed
+  unsigned long dataWrites; //HD44780 characters written
+  unsigned long clears; //clear display commands
+
+  void reset() {
+    memset(this, 0, sizeof(*this));
+    memset(ddram, ' ', sizeof(ddram));
+  }
+
+  // Executes one 8-bit command or data write
+  void execute(byte value, bool isData) {
+    if (isData) {
+      dataWrites++;
+      if (cgramMode) {
+        cgram[address & 0x3F] = value;
+        address = (address + 1) & 0x3F;
+      } else {
+        ddram[address & 0x7F] = (char)value;
+        address = (address + 1) & 0x7F;
+      }
+      return;
+    }
+    commands++;
+    if (value & 0x80) { //set DDRAM address
+      address = value & 0x7F;
+      cgramMode = false;
+    } else if (value & 0x40) { //set CGRAM address
+      address = value & 0x3F;
+      cgramMode = true;
+    } else if (value == 0x01) { //clear display
+      memset(ddram, ' ', sizeof(ddram));
+      address = 0;
+      cgramMode = false;
+      clears++;
+    } else if ((value & 0xFE) == 0x02) { //return home
+      address = 0;
+      cgramMode = false;
+    }
+  }
+
+  // Decodes one byte written to the PCF8574 (D4-D7 on P4-P7, EN on P2, RS on P0, backlight on P3)
+  void pins(byte value) {
+    backlight = (value & 0x08) != 0;
+    if ((lastPins & 0x04) && !(value & 0x04)) { //falling edge of EN latches 4 bits
+      byte bits = lastPins & 0xF0;
+      if (haveNibble) {
+        execute(nibble | (bits >> 4), (lastPins & 0x01) != 0);
+        haveNibble = false;
+      } else {
+        nibble = bits;
+        haveNibble = true;
+      }
+    }
+    lastPins = value;
+  }
+
+  // Copies one row of the display into text (17 bytes)
+  void row(byte index, char *text) const {
+    memcpy(text, &ddram[index ? 0x40 : 0x00], 16);
+    text[16] = '\0';
+  }
+};
+
+extern SimDisplay simDisplays[STATIONS]; //LCD of each station, at I2C address 0x27 - station
+extern SimDisplay &simDisplay; //LCD of the first station
+extern byte simStations; //stations wired to the board, set before setup()
+
+// Function used to find the station of an LCD address, -1 if no LCD answers there
+inline int simLcdStation(byte address) {
+  int station = 0x27 - address;
+  return ((station >= 0) && (station < simStations)) ? station : -1;
+}
+
+// Keypad expanders of the stations after the first one, at I2C address 0x38 + station - 1 (defined by the simulator)
+int simExpanderStation(byte address); //-1 if no expander answers there
+void simExpanderWrite(int station, byte value);
+byte simExpanderRead(int station);
+
+// I2C bus, every transmission is decoded by the simulated LCD or keypad expander at its address
+class TwoWire
+{
+  public:
+    void begin() {}
+    void setClock(unsigned long) {}
+    void beginTransmission(uint8_t address) {
+      target = address;
+      simBusBytes++; //address byte
+      int station = simLcdStation(address);
+      if (station >= 0) {
+        simDisplays[station].busBytes++;
+        simDisplays[station].transactions++;
+      }
+    }
+    size_t write(uint8_t value) {
+      simBusBytes++;
+      int station = simLcdStation(target);
+      if (station >= 0) {
+        simDisplays[station].busBytes++;
+        simDisplays[station].pins(value);
+      } else if ((station = simExpanderStation(target)) >= 0) {
+        simExpanderWrite(station, value);
+      }
+      return 1;
+    }
+    uint8_t endTransmission() {
+      return ((simLcdStation(target) >= 0) || (simExpanderStation(target) >= 0)) ? 0 : 2; //2: address not acknowledged
+    }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) {
+      simBusBytes += 1 + quantity;
+      int station = simExpanderStation(address);
+      if (station < 0) {
+        return 0;
+      }
+      received = simExpanderRead(station);
+      return quantity;
+    }
+    int read() {
+      return received;
+    }
+
+  private:
+    byte target = 0; //address of the current transmission
+    byte received = 0xFF; //byte read by the last request
+};
+
+extern TwoWire Wire;
+
+// LCD library, commands go straight to the simulated display with the bus cost of the real library
+class LiquidCrystal_I2C
+{
+  public:
+    static const byte BYTES_PER_WRITE = 12; //6 single-byte transactions per command or character
+
+    LiquidCrystal_I2C(byte lcdAddress, byte, byte) : address(lcdAddress) {}
+
+    void init() {
+      display().reset();
+    }
+    void clear() {
+      send(0x01, false);
+    }
+    void backlight() {
+      display().backlight = true;
+      display().lastPins |= 0x08;
+      display().busBytes += 2;
+      display().transactions++;
+      simBusBytes += 2;
+    }
+    void noBacklight() {
+      display().backlight = false;
+      display().lastPins &= ~0x08;
+      display().busBytes += 2;
+      display().transactions++;
+      simBusBytes += 2;
+    }
+    void createChar(byte location, byte charmap[]) {
+      send(0x40 | ((location & 0x7) << 3), false);
+      for (byte i = 0; i < 8; i++) {
+        send(charmap[i], true);
+      }
+    }
+
+  private:
+    byte address; //I2C address of the backpack
+
+    SimDisplay &display() {
+      return simDisplays[0x27 - address];
+    }
+    void send(byte value, bool isData) {
+      display().busBytes += BYTES_PER_WRITE;
+      display().transactions += BYTES_PER_WRITE / 2;
+      simBusBytes += BYTES_PER_WRITE;
+      display().execute(value, isData);
+    }
+};
+
+// Keypad library, scans a key matrix whose keys are pressed and released by the simulated typist
+#define makeKeymap(x) ((char *)x)
+#define NO_KEY '\0'
+#define LIST_MAX 10
+
+typedef enum { IDLE, PRESSED, HOLD, RELEASED } KeyState;
+
+struct Key {
+  char kchar;
+  int kcode;
+  KeyState kstate;
+  bool stateChanged;
+};
+
+extern byte simKeyDown[STATIONS][128]; //keys physically held down on each station, indexed by character
+
+class Keypad
+{
+  public:
+    Key key[LIST_MAX]; //keys being tracked, like the library
+    unsigned long startTime; //time of the last scan
+    unsigned int debounceTime; //minimum time between two scans
+
+    Keypad(char *, byte *, byte *, byte, byte) : startTime(0), debounceTime(10) {
+      for (byte i = 0; i < LIST_MAX; i++) {
+        key[i].kchar = NO_KEY;
+        key[i].kcode = -1;
+        key[i].kstate = IDLE;
+        key[i].stateChanged = false;
+      }
+    }
+
+    void setDebounceTime(unsigned int debounce) {
+      debounceTime = (debounce < 1) ? 1 : debounce;
+    }
+
+    // Scans the matrix at most once per debounce time, returns true if a key changed state
+    bool getKeys() {
+      if ((millis() - startTime) <= debounceTime) {
+        return false;
+      }
+      startTime = millis();
+      bool activity = false;
+      for (byte i = 0; i < LIST_MAX; i++) { //update the keys already in the list
+        key[i].stateChanged = false;
+        if (key[i].kchar == NO_KEY) {
+          continue;
+        }
+        bool down = simKeyDown[0][(byte)key[i].kchar] != 0; //the matrix keypad is the one of the first station
+        if (((key[i].kstate == PRESSED) || (key[i].kstate == HOLD)) && !down) {
+          key[i].kstate = RELEASED;
+          key[i].stateChanged = true;
+          activity = true;
+        } else if (key[i].kstate == RELEASED) {
+          key[i].kstate = IDLE;
+          key[i].kchar = NO_KEY;
+          key[i].stateChanged = true;
+          activity = true;
+        }
+      }
+      for (byte c = 1; c < 128; c++) { //add the keys that have just been pressed
+        if (!simKeyDown[0][c] || tracked((char)c)) {
+          continue;
+        }
+        for (byte i = 0; i < LIST_MAX; i++) {
+          if (key[i].kchar == NO_KEY) {
+            key[i].kchar = (char)c;
+            key[i].kstate = PRESSED;
+            key[i].stateChanged = true;
+            activity = true;
+            break;
+          }
+        }
+      }
+      return activity;
+    }
+
+    // Returns the first key of the list if it has just been pressed
+    char getKey() {
+      if (getKeys() && key[0].stateChanged && (key[0].kstate == PRESSED)) {
+        return key[0].kchar;
+      }
+      return NO_KEY;
+    }
+
+  private:
+    bool tracked(char c) {
+      for (byte i = 0; i < LIST_MAX; i++) {
+        if ((key[i].kchar == c) && (key[i].kstate != IDLE)) {
+          return true;
+        }
+      }
+      return false;
+    }
+};
+
+// Simulated typist: presses the queued keys one after the other, each key is held for holdUs
+struct SimTypist {
+  char queue[256]; //keys waiting to be pressed
+  byte head; //next key to press
+  byte tail; //where the next queued key goes
+  char down[8]; //keys currently held
+  uint64_t releaseAt[8]; //time each held key is released
+  uint64_t nextPressAt; //earliest time of the next press
+  uint64_t holdUs; //time a key stays down
+  uint64_t periodUs; //time between two presses (shorter than holdUs for rollover)
+  unsigned long pressed; //number of keys pressed so far
+  uint64_t pressTimes[64]; //time of the last presses, indexed by press number
+};
+
+extern SimTypist simTypists[STATIONS]; //typist of each station
+extern SimTypist &simTypist; //typist of the first station
+
+// Function used by the simulator to queue a key for the typist of a station, returns false if too many keys are waiting
+inline bool simPressKey(char key, byte station = 0) {
+  SimTypist &typist = simTypists[station];
+  byte next = typist.tail + 1;
+  if (next == typist.head) {
+    return false;
+  }
+  typist.queue[typist.tail] = key;
+  typist.tail = next;
+  return true;
+}
+
+// Function used to know if the typist of a station still has keys to press or release
+inline bool simTypistBusy(byte station = 0) {
+  const SimTypist &typist = simTypists[station];
+  if (typist.head != typist.tail) {
+    return true;
+  }
+  for (byte i = 0; i < sizeof(typist.down); i++) {
+    if (typist.down[i] != NO_KEY) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Function used to press and release keys according to the virtual clock
+inline void simTypistUpdate() {
+  for (byte station = 0; station < STATIONS; station++) {
+    SimTypist &typist = simTypists[station];
+    for (byte i = 0; i < sizeof(typist.down); i++) { //release the keys held long enough
+      if ((typist.down[i] != NO_KEY) && (simMicros >= typist.releaseAt[i])) {
+        simKeyDown[station][(byte)typist.down[i]]--;
+        typist.down[i] = NO_KEY;
+      }
+    }
+    if ((typist.head == typist.tail) || (simMicros < typist.nextPressAt)) {
+      continue;
+    }
+    for (byte i = 0; i < sizeof(typist.down); i++) { //press the next key
+      if (typist.down[i] == NO_KEY) {
+        char key = typist.queue[typist.head++];
+        typist.down[i] = key;
+        typist.releaseAt[i] = simMicros + typist.holdUs;
+        simKeyDown[station][(byte)key]++;
+        typist.nextPressAt = simMicros + typist.periodUs;
+        typist.pressTimes[typist.pressed % 64] = simMicros;
+        typist.pressed++;
+        break;
+      }
+    }
+  }
+}
+
+// Interrupts are only simulated between two loop() calls, there is nothing to mask
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Host time in nanoseconds, used for the profiler time stamps since the virtual clock stands still inside loop()
+inline uint64_t simHostNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Serial port: bytes waiting to be received by the board and bytes it has sent
+extern std::vector<byte> simUartRx;
+extern std::vector<byte> simUartTx;
+
+inline bool simUartReceive(byte &value) {
+  if (simUartRx.empty()) {
+    return false;
+  }
+  value = simUartRx.front();
+  simUartRx.erase(simUartRx.begin());
+  return true;
+}
+
+inline void simUartSend(const byte *data, unsigned int length) {
+  simUartTx.insert(simUartTx.end(), data, data + length);
+}
+
+// Function called every time the virtual clock crosses a millisecond, like the Timer0 interrupt
+extern void (*simMillisecondHook)();
+
+// Function called with the 0.5 ms ticks of virtual time while the Timer1 interrupt is enabled, 0 otherwise. It returns how many of
+// them it played, so the clock jumps from one change of the outputs to the next instead of calling it on every tick.
+extern unsigned long (*simTimer1Hook)(unsigned long ticks);
+
+// Power-down sleep: no loop() and no timer interrupt until the IR sensor output changes
+extern bool simAsleep; //if the board is sleeping
+extern uint64_t simSleepMicros; //virtual time spent sleeping
+
+inline void simSleep() {
+  simAsleep = true;
+}
+
+// 1 KB EEPROM image
+class EEPROMClass
+{
+  public:
+    static const unsigned int SIZE = 1024;
+    byte image[SIZE]; //content of the EEPROM
+    unsigned long cellWrites[SIZE]; //number of times each cell has been written
+    unsigned long writes; //total number of cell writes
+
+    EEPROMClass() {
+      erase();
+    }
+    void erase() {
+      memset(image, 0xFF, sizeof(image));
+      memset(cellWrites, 0, sizeof(cellWrites));
+      writes = 0;
+    }
+    byte read(int address) {
+      return image[address % SIZE];
+    }
+    void write(int address, byte value) {
+      image[address % SIZE] = value;
+      cellWrites[address % SIZE]++;
+      writes++;
+    }
+    void update(int address, byte value) {
+      if (read(address) != value) {
+        write(address, value);
+      }
+    }
+    unsigned int length() {
+      return SIZE;
+    }
+    template <typename T> T &get(int address, T &value) {
+      byte *bytes = (byte *)&value;
+      for (size_t i = 0; i < sizeof(T); i++) {
+        bytes[i] = read(address + i);
+      }
+      return value;
+    }
+    template <typename T> const T &put(int address, const T &value) {
+      const byte *bytes = (const byte *)&value;
+      for (size_t i = 0; i < sizeof(T); i++) {
+        update(address + i, bytes[i]);
+      }
+      return value;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+// Function used by the simulator to move the virtual clock forward, the typist and the millisecond interrupt run on the way
+inline void simAdvance(uint64_t us) {
+  if (simAsleep) { //every clock is stopped, the virtual clock still runs since the game has no deadline while idle
+    simMicros += us;
+    simSleepMicros += us;
+    simTypistUpdate();
+    return;
+  }
+  uint64_t before = simMicros / 1000;
+  uint64_t last = (simMicros + us) / 500;
+  for (uint64_t tick = simMicros / 500 + 1; (simTimer1Hook != 0) && (tick <= last);) {
+    tick += simTimer1Hook((unsigned long)(last - tick + 1)); //every Timer1 tick on the way, the hook can stop the timer
+  }
+  simMicros += us;
+  simTypistUpdate();
+  if (((simMicros / 1000) != before) && (simMillisecondHook != 0)) { //one tick per jump is enough, nothing changes in between
+    simMillisecondHook();
+  }
+}
+
+#endif